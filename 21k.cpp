@@ -1,3 +1,6 @@
+// Build: g++ -std=c++17 -O2 -DNDEBUG -pthread 21k.cpp -o 21k
+// Without -DNDEBUG, asserts and checked Money arithmetic stay on.
+
 #include <iostream>
 #include <string>
 #include <vector>
@@ -6,129 +9,5122 @@
 #include <thread>      
 #include <chrono>
 #include <limits>      
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cassert>
+#include <new>
+#include <atomic>
+#include <mutex>
+#include <csignal>
+#include <condition_variable>
+#include <fstream>
+#include <unordered_map>
+#include <memory>
+#if defined(__unix__) || defined(__APPLE__)
+#define OBSERVER_SOCKETS
+#define EV_TABLE_MMAP
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+#if defined(__linux__)
+#define WAKEUP_SEMAPHORE
+#include <semaphore.h>
+#endif
+
+// --- Necessary Struct and Enum Definitions ---
+
+// English Suit Names
+const char* const SUIT_NAMES[] = {"Hearts", "Spades", "Diamonds", "Clubs"};
+// English Rank Names
+const char* const RANK_NAMES[] = {"Ace", "2", "3", "4", "5", "6", "7", "8", "9", "10", "Jack", "Queen", "King"};
+const int ACE = 0; // Index of "Ace" in RANK_NAMES
+
+// Cards are indices into the name tables, so dealing one copies three bytes
+struct Card {
+    unsigned char suit;
+    unsigned char rank;
+    unsigned char value;
+};
+
+// Fixed-capacity vector kept inline, so per-round state never touches the heap
+template <typename T, int Capacity>
+class InlineVector {
+public:
+    void push_back(const T& item) {
+        assert(count < Capacity);
+        items[count++] = item;
+    }
+    void pop_back() { --count; }
+    void clear() { count = 0; }
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](int i) { return items[i]; }
+    const T& operator[](int i) const { return items[i]; }
+    T& back() { return items[count - 1]; }
+    const T& back() const { return items[count - 1]; }
+    T* begin() { return items; }
+    T* end() { return items + count; }
+    const T* begin() const { return items; }
+    const T* end() const { return items + count; }
+
+private:
+    T items[Capacity];
+    int count = 0;
+};
+
+// 21 Aces counted as 1 plus the card that busts them: no hand can hold more
+const int MAX_HAND_CARDS = 22;
+typedef InlineVector<Card, MAX_HAND_CARDS> Hand;
+
+// --- Money ---
+// Amounts are whole cents in a 64-bit integer, so a 3:2 payout on an odd bet
+// is exact and house aggregates cannot wrap in any realistic run. Debug builds
+// check every operation for overflow; with NDEBUG the checks compile away and
+// Money is plain int64 arithmetic.
+
+class Money {
+public:
+    constexpr Money() : cents(0) {}
+    static constexpr Money fromCents(long long cents) { return Money(cents); }
+    static Money dollars(long long whole) { return Money(checkedMul(whole, 100)); }
+
+    constexpr long long inCents() const { return cents; }
+    constexpr long long wholeDollars() const { return cents / 100; }
+
+    Money operator+(Money other) const { return Money(checkedAdd(cents, other.cents)); }
+    Money operator-(Money other) const { return Money(checkedAdd(cents, checkedMul(other.cents, -1))); }
+    Money operator-() const { return Money(checkedMul(cents, -1)); }
+    Money operator*(long long factor) const { return Money(checkedMul(cents, factor)); }
+    Money& operator+=(Money other) { return *this = *this + other; }
+    Money& operator-=(Money other) { return *this = *this - other; }
+
+    // Multiplies by num/den, dropping any fraction of a cent
+    Money scaled(long long num, long long den) const { return Money(checkedMul(cents, num) / den); }
+
+    Money absolute() const { return cents < 0 ? -*this : *this; }
+
+    constexpr bool operator==(Money other) const { return cents == other.cents; }
+    constexpr bool operator!=(Money other) const { return cents != other.cents; }
+    constexpr bool operator<(Money other) const { return cents < other.cents; }
+    constexpr bool operator<=(Money other) const { return cents <= other.cents; }
+    constexpr bool operator>(Money other) const { return cents > other.cents; }
+    constexpr bool operator>=(Money other) const { return cents >= other.cents; }
+
+    // "12" for whole dollars, "12.50" otherwise
+    std::string toString() const {
+        char text[32];
+        unsigned long long magnitude = cents < 0 ? 0ULL - static_cast<unsigned long long>(cents) : cents;
+        if (magnitude % 100 == 0) {
+            std::snprintf(text, sizeof(text), "%s%llu", cents < 0 ? "-" : "", magnitude / 100);
+        } else {
+            std::snprintf(text, sizeof(text), "%s%llu.%02llu", cents < 0 ? "-" : "", magnitude / 100, magnitude % 100);
+        }
+        return text;
+    }
+
+private:
+    constexpr explicit Money(long long cents) : cents(cents) {}
+
+    static long long checkedAdd(long long a, long long b) {
+#ifdef NDEBUG
+        return a + b;
+#else
+        long long result;
+        bool overflow = __builtin_add_overflow(a, b, &result);
+        assert(!overflow && "Money overflow");
+        (void)overflow;
+        return result;
+#endif
+    }
+
+    static long long checkedMul(long long a, long long b) {
+#ifdef NDEBUG
+        return a * b;
+#else
+        long long result;
+        bool overflow = __builtin_mul_overflow(a, b, &result);
+        assert(!overflow && "Money overflow");
+        (void)overflow;
+        return result;
+#endif
+    }
+
+    long long cents;
+};
+
+inline std::ostream& operator<<(std::ostream& out, Money amount) {
+    return out << amount.toString();
+}
+
+// Smallest bet the table takes
+constexpr Money TABLE_MIN_BET = Money::fromCents(100);
+
+enum PlayerStatus {
+    PLAYING,  
+    STANDING, 
+    BUSTED,   
+    BLACKJACK,
+    QUIT      
+};
+
+inline unsigned statusBit(PlayerStatus status) {
+    return 1u << status;
+}
+
+// Every seat still at the table
+const unsigned ACTIVE_SEATS = (1u << PLAYING) | (1u << STANDING) | (1u << BUSTED) | (1u << BLACKJACK);
+
+// Seats stored column by column. Each status has a dense bitmap, so phase
+// loops visit only the seats they care about; balances and bets are packed
+// arrays and names stay out of the way until something is printed.
+class SeatTable {
+public:
+    // Iterates, in seat order, the seats whose status is in a mask
+    class SeatIterator {
+    public:
+        SeatIterator(const SeatTable* table, unsigned mask, int word)
+            : table(table), mask(mask), word(word), bits(0) {
+            load();
+        }
+        int operator*() const { return word * 64 + __builtin_ctzll(bits); }
+        SeatIterator& operator++() {
+            bits &= bits - 1;
+            if (bits == 0) {
+                ++word;
+                load();
+            }
+            return *this;
+        }
+        bool operator!=(const SeatIterator& other) const { return word != other.word || bits != other.bits; }
+
+    private:
+        // Skips to the next word holding a matching seat
+        void load() {
+            int words = static_cast<int>(table->statusBits[0].size());
+            while (word < words && (bits = table->maskedWord(mask, word)) == 0) ++word;
+        }
+
+        const SeatTable* table;
+        unsigned mask;
+        int word;
+        unsigned long long bits;
+    };
+
+    struct SeatRange {
+        const SeatTable* table;
+        unsigned mask;
+        SeatIterator begin() const { return SeatIterator(table, mask, 0); }
+        SeatIterator end() const { return SeatIterator(table, 0, static_cast<int>(table->statusBits[0].size())); }
+    };
+
+    std::vector<std::string> names; // Cold: only read for display
+    std::vector<Hand> hands;
+    std::vector<Money> money;
+    std::vector<Money> bets;
+    std::vector<Money> pairBets;       // Perfect Pairs side bet, zero for none
+    std::vector<Money> threeCardBets;  // 21+3 side bet, zero for none
+
+    int addSeat(const std::string& name, Money startingMoney) {
+        int seat = size();
+        if (seat % 64 == 0) {
+            for (auto& bitmap : statusBits) bitmap.push_back(0);
+        }
+        names.push_back(name);
+        hands.emplace_back();
+        money.push_back(startingMoney);
+        bets.push_back(Money());
+        pairBets.push_back(Money());
+        threeCardBets.push_back(Money());
+        status.push_back(PLAYING);
+        statusBits[PLAYING][seat / 64] |= 1ULL << (seat % 64);
+        return seat;
+    }
+
+    int size() const { return static_cast<int>(status.size()); }
+    PlayerStatus statusOf(int seat) const { return static_cast<PlayerStatus>(status[seat]); }
+
+    void setStatus(int seat, PlayerStatus newStatus) {
+        unsigned long long bit = 1ULL << (seat % 64);
+        statusBits[status[seat]][seat / 64] &= ~bit;
+        statusBits[newStatus][seat / 64] |= bit;
+        status[seat] = static_cast<unsigned char>(newStatus);
+    }
+
+    // True if any seat currently has the given status
+    bool any(PlayerStatus s) const {
+        for (unsigned long long word : statusBits[s]) {
+            if (word != 0) return true;
+        }
+        return false;
+    }
+
+    SeatRange seats(unsigned mask) const { return SeatRange{this, mask}; }
+
+private:
+    unsigned long long maskedWord(unsigned mask, int word) const {
+        unsigned long long bits = 0;
+        for (int s = 0; s <= QUIT; ++s) {
+            if (mask & (1u << s)) bits |= statusBits[s][word];
+        }
+        return bits;
+    }
+
+    std::vector<unsigned char> status;
+    std::vector<unsigned long long> statusBits[QUIT + 1];
+};
+
+// --- Phase Profiling ---
+// Build with -DBJ_PROFILE to time each phase of the round loop. Without it the
+// PROFILE_PHASE macro expands to nothing and no profiling code is compiled in.
+
+enum Phase {
+    PHASE_BET_INPUT,
+    PHASE_DEALING,
+    PHASE_DECISION,
+    PHASE_DEALER_PLAY,
+    PHASE_SETTLEMENT,
+    PHASE_CONTINUE_INPUT,
+    PHASE_RENDERING,
+    PHASE_COUNT
+};
+
+const char* const PHASE_NAMES[] = {"bet input", "dealing", "player decision", "dealer play",
+                                   "settlement", "continue input", "rendering"};
+
+#ifdef BJ_PROFILE
+
+// Log2 histogram of nanosecond durations. Only the owning thread writes, so
+// updates are relaxed load/store pairs and a dump from another thread is safe.
+struct PhaseHistogram {
+    std::atomic<unsigned long long> buckets[64];
+    std::atomic<unsigned long long> count;
+    std::atomic<unsigned long long> totalNs;
+    std::atomic<unsigned long long> maxNs;
+
+    void record(unsigned long long ns) {
+        int bucket = ns == 0 ? 0 : 63 - __builtin_clzll(ns);
+        buckets[bucket].store(buckets[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        totalNs.store(totalNs.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+        if (ns > maxNs.load(std::memory_order_relaxed)) maxNs.store(ns, std::memory_order_relaxed);
+    }
+};
+
+struct ThreadProfile {
+    PhaseHistogram phases[PHASE_COUNT] = {};
+};
+
+std::mutex profileRegistryMutex;
+std::vector<ThreadProfile*> profileRegistry;
+std::atomic<bool> profileDumpRequested(false);
+
+// Each thread's profile is registered once and kept alive so it can still be dumped after the thread exits
+ThreadProfile& threadProfile() {
+    thread_local ThreadProfile* profile = [] {
+        ThreadProfile* created = new ThreadProfile();
+        std::lock_guard<std::mutex> lock(profileRegistryMutex);
+        profileRegistry.push_back(created);
+        return created;
+    }();
+    return *profile;
+}
+
+// Times a phase exclusively: while a nested phase runs, the enclosing one is paused
+class ScopedPhase {
+public:
+    explicit ScopedPhase(Phase phase) : phase(phase), parent(current), elapsed(0) {
+        auto now = std::chrono::steady_clock::now();
+        if (parent) parent->pause(now);
+        resumedAt = now;
+        current = this;
+    }
+    ~ScopedPhase() {
+        auto now = std::chrono::steady_clock::now();
+        pause(now);
+        threadProfile().phases[phase].record(elapsed);
+        current = parent;
+        if (parent) parent->resumedAt = now;
+    }
+
+private:
+    void pause(std::chrono::steady_clock::time_point now) {
+        elapsed += std::chrono::duration_cast<std::chrono::nanoseconds>(now - resumedAt).count();
+    }
+
+    static thread_local ScopedPhase* current;
+    Phase phase;
+    ScopedPhase* parent;
+    unsigned long long elapsed;
+    std::chrono::steady_clock::time_point resumedAt;
+};
+
+thread_local ScopedPhase* ScopedPhase::current = nullptr;
+
+// Upper bound of the bucket holding the given quantile, capped at the observed maximum
+double histogramQuantileUs(const unsigned long long* buckets, unsigned long long count, unsigned long long maxNs, double q) {
+    unsigned long long target = static_cast<unsigned long long>(q * count);
+    unsigned long long seen = 0;
+    for (int b = 0; b < 64; ++b) {
+        seen += buckets[b];
+        if (seen > target) return std::min(std::ldexp(1.0, b + 1), static_cast<double>(maxNs)) / 1000.0;
+    }
+    return 0.0;
+}
+
+// Prints every thread's phase histograms merged together
+void dumpPhaseProfile() {
+    std::lock_guard<std::mutex> lock(profileRegistryMutex);
+    std::cout << "\n--- PHASE PROFILE ---" << std::endl;
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-16s %8s %12s %10s %10s %10s %10s", "phase", "count", "total ms",
+                  "mean us", "p50 us", "p99 us", "max us");
+    std::cout << line << std::endl;
+    for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+        unsigned long long buckets[64] = {};
+        unsigned long long count = 0, totalNs = 0, maxNs = 0;
+        for (ThreadProfile* profile : profileRegistry) {
+            const PhaseHistogram& h = profile->phases[phase];
+            for (int b = 0; b < 64; ++b) buckets[b] += h.buckets[b].load(std::memory_order_relaxed);
+            count += h.count.load(std::memory_order_relaxed);
+            totalNs += h.totalNs.load(std::memory_order_relaxed);
+            maxNs = std::max(maxNs, h.maxNs.load(std::memory_order_relaxed));
+        }
+        if (count == 0) continue;
+        std::snprintf(line, sizeof(line), "%-16s %8llu %12.3f %10.1f %10.1f %10.1f %10.1f", PHASE_NAMES[phase],
+                      count, totalNs / 1e6, totalNs / 1e3 / count, histogramQuantileUs(buckets, count, maxNs, 0.5),
+                      histogramQuantileUs(buckets, count, maxNs, 0.99), maxNs / 1e3);
+        std::cout << line << std::endl;
+    }
+}
+
+#ifdef SIGUSR1
+// kill -USR1 <pid> asks the table for a dump at the start of the next round
+extern "C" void requestProfileDump(int) {
+    profileDumpRequested.store(true, std::memory_order_relaxed);
+}
+#endif
+
+void installProfileSignal() {
+#ifdef SIGUSR1
+    std::signal(SIGUSR1, requestProfileDump);
+#endif
+}
+
+// Dumps the profile if a dump was requested since the last check
+void pollProfileDump() {
+    if (profileDumpRequested.exchange(false, std::memory_order_relaxed)) dumpPhaseProfile();
+}
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_PHASE(phase) ScopedPhase PROFILE_CONCAT(phaseTimer, __LINE__)(phase)
+#define PROFILE_INSTALL() installProfileSignal()
+#define PROFILE_POLL() pollProfileDump()
+#define PROFILE_DUMP() dumpPhaseProfile()
+
+#else
+
+#define PROFILE_PHASE(phase) ((void)0)
+#define PROFILE_INSTALL() ((void)0)
+#define PROFILE_POLL() ((void)0)
+#define PROFILE_DUMP() ((void)0)
+
+#endif
+
+// --- Table Metrics ---
+// Counters live in per-thread shards. Each shard has one writer, so an update
+// is a relaxed load and store with no locked instruction, and a scrape only
+// reads. Nothing a scraper does can stall a table thread.
+
+enum Metric {
+    METRIC_ROUNDS,
+    METRIC_HANDS_DEALT,
+    METRIC_RESHUFFLES,
+    METRIC_HOUSE_NET, // In cents
+    METRIC_BLACKJACK_WIN,
+    METRIC_BUSTED_LOSS,
+    METRIC_STANDING_WIN,
+    METRIC_STANDING_LOSS,
+    METRIC_STANDING_PUSH,
+    METRIC_COUNT
+};
+
+// Latency buckets: four per power of two of nanoseconds
+const int LATENCY_BUCKETS = 256;
+
+struct alignas(64) MetricShard {
+    std::atomic<long long> values[METRIC_COUNT] = {};
+    std::atomic<unsigned long long> latencyBuckets[LATENCY_BUCKETS] = {};
+    std::atomic<unsigned long long> latencyCount{0};
+    std::atomic<unsigned long long> latencySumNs{0};
+};
+
+std::mutex metricRegistryMutex;
+std::vector<MetricShard*> metricRegistry;
+
+MetricShard& metricShard() {
+    thread_local MetricShard* shard = [] {
+        MetricShard* created = new MetricShard();
+        std::lock_guard<std::mutex> lock(metricRegistryMutex);
+        metricRegistry.push_back(created);
+        return created;
+    }();
+    return *shard;
+}
+
+inline void addMetric(Metric metric, long long delta = 1) {
+    std::atomic<long long>& value = metricShard().values[metric];
+    value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+int latencyBucket(unsigned long long ns) {
+    if (ns < 4) return static_cast<int>(ns);
+    int octave = 63 - __builtin_clzll(ns);
+    int sub = static_cast<int>((ns >> (octave - 2)) & 3);
+    return std::min(LATENCY_BUCKETS - 1, octave * 4 + sub);
+}
+
+// Midpoint of a latency bucket, in nanoseconds
+double latencyBucketMidNs(int bucket) {
+    if (bucket < 4) return bucket;
+    int octave = bucket / 4;
+    int sub = bucket % 4;
+    double low = std::ldexp(4.0 + sub, octave - 2);
+    return low + std::ldexp(1.0, octave - 3);
+}
+
+void recordDecisionLatency(unsigned long long ns) {
+    MetricShard& shard = metricShard();
+    std::atomic<unsigned long long>& bucket = shard.latencyBuckets[latencyBucket(ns)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    shard.latencyCount.store(shard.latencyCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    shard.latencySumNs.store(shard.latencySumNs.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+}
+
+// Sum of all shards at one point in time
+struct MetricSnapshot {
+    long long values[METRIC_COUNT] = {};
+    unsigned long long latencyBuckets[LATENCY_BUCKETS] = {};
+    unsigned long long latencyCount = 0;
+    unsigned long long latencySumNs = 0;
+
+    double latencyQuantileNs(double q) const {
+        unsigned long long target = static_cast<unsigned long long>(q * latencyCount);
+        unsigned long long seen = 0;
+        for (int b = 0; b < LATENCY_BUCKETS; ++b) {
+            seen += latencyBuckets[b];
+            if (seen > target) return latencyBucketMidNs(b);
+        }
+        return 0.0;
+    }
+};
+
+MetricSnapshot collectMetrics() {
+    MetricSnapshot snapshot;
+    std::lock_guard<std::mutex> lock(metricRegistryMutex);
+    for (MetricShard* shard : metricRegistry) {
+        for (int m = 0; m < METRIC_COUNT; ++m) snapshot.values[m] += shard->values[m].load(std::memory_order_relaxed);
+        for (int b = 0; b < LATENCY_BUCKETS; ++b) {
+            snapshot.latencyBuckets[b] += shard->latencyBuckets[b].load(std::memory_order_relaxed);
+        }
+        snapshot.latencyCount += shard->latencyCount.load(std::memory_order_relaxed);
+        snapshot.latencySumNs += shard->latencySumNs.load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+// Renders a snapshot in the Prometheus text exposition format
+std::string formatMetrics(const MetricSnapshot& m, double roundsPerSecond) {
+    std::string out;
+    char line[200];
+    auto counter = [&](const char* name, const char* help, long long value) {
+        std::snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s counter\n%s %lld\n", name, help, name, name, value);
+        out += line;
+    };
+    counter("blackjack_rounds_total", "Rounds played.", m.values[METRIC_ROUNDS]);
+    counter("blackjack_hands_dealt_total", "Player hands dealt.", m.values[METRIC_HANDS_DEALT]);
+    counter("blackjack_reshuffles_total", "Reshuffles at the cut card and mid-round refills.", m.values[METRIC_RESHUFFLES]);
+
+    std::snprintf(line, sizeof(line),
+                  "# HELP blackjack_rounds_per_second Round rate since the previous export.\n"
+                  "# TYPE blackjack_rounds_per_second gauge\nblackjack_rounds_per_second %.3f\n", roundsPerSecond);
+    out += line;
+    std::snprintf(line, sizeof(line),
+                  "# HELP blackjack_house_net_win House winnings minus payouts, in dollars.\n"
+                  "# TYPE blackjack_house_net_win gauge\nblackjack_house_net_win %s\n",
+                  Money::fromCents(m.values[METRIC_HOUSE_NET]).toString().c_str());
+    out += line;
+
+    out += "# HELP blackjack_outcomes_total Settled hands by final status and result.\n"
+           "# TYPE blackjack_outcomes_total counter\n";
+    const struct { const char* status; const char* result; Metric metric; } outcomes[] = {
+        {"BLACKJACK", "win", METRIC_BLACKJACK_WIN},
+        {"BUSTED", "loss", METRIC_BUSTED_LOSS},
+        {"STANDING", "win", METRIC_STANDING_WIN},
+        {"STANDING", "loss", METRIC_STANDING_LOSS},
+        {"STANDING", "push", METRIC_STANDING_PUSH},
+    };
+    for (const auto& o : outcomes) {
+        std::snprintf(line, sizeof(line), "blackjack_outcomes_total{status=\"%s\",result=\"%s\"} %lld\n",
+                      o.status, o.result, m.values[o.metric]);
+        out += line;
+    }
+
+    out += "# HELP blackjack_decision_latency_seconds Time a player takes to choose Hit or Stand.\n"
+           "# TYPE blackjack_decision_latency_seconds summary\n";
+    const double quantiles[] = {0.5, 0.9, 0.99};
+    for (double q : quantiles) {
+        std::snprintf(line, sizeof(line), "blackjack_decision_latency_seconds{quantile=\"%g\"} %.6f\n", q,
+                      m.latencyQuantileNs(q) / 1e9);
+        out += line;
+    }
+    std::snprintf(line, sizeof(line),
+                  "blackjack_decision_latency_seconds_sum %.6f\nblackjack_decision_latency_seconds_count %llu\n",
+                  m.latencySumNs / 1e9, m.latencyCount);
+    out += line;
+    return out;
+}
+
+// Periodically writes the metrics to a file, replacing it atomically so a
+// scraper never reads a partial export
+class MetricsExporter {
+public:
+    void start(const std::string& exportPath, double intervalSeconds) {
+        path = exportPath;
+        interval = std::chrono::duration<double>(intervalSeconds);
+        lastRounds = 0;
+        lastExport = std::chrono::steady_clock::now();
+        worker = std::thread([this] { run(); });
+    }
+
+    // Writes a final export and joins the exporter thread
+    void stop() {
+        if (!worker.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+        exportNow();
+    }
+
+    ~MetricsExporter() { stop(); }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wake.wait_for(lock, interval, [this] { return stopping; })) {
+            lock.unlock();
+            exportNow();
+            lock.lock();
+        }
+    }
+
+    void exportNow() {
+        MetricSnapshot snapshot = collectMetrics();
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastExport).count();
+        double rate = elapsed > 0.0 ? (snapshot.values[METRIC_ROUNDS] - lastRounds) / elapsed : 0.0;
+        lastRounds = snapshot.values[METRIC_ROUNDS];
+        lastExport = now;
+
+        std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream out(tmpPath, std::ios::trunc);
+            out << formatMetrics(snapshot, rate);
+        }
+        std::rename(tmpPath.c_str(), path.c_str());
+    }
+
+    std::string path;
+    std::chrono::duration<double> interval{1.0};
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    long long lastRounds = 0;
+    std::chrono::steady_clock::time_point lastExport;
+};
+
+// --- Helper Functions ---
+
+// Card value of each rank, in RANK_NAMES order; an Ace counts 11 until it busts the hand
+constexpr unsigned char RANK_VALUES[13] = {11, 2, 3, 4, 5, 6, 7, 8, 9, 10, 10, 10, 10};
+
+// The standard 52-card deck in suit-major order, built by the compiler
+struct CanonicalDeck {
+    Card cards[52];
+};
+
+constexpr CanonicalDeck makeCanonicalDeck() {
+    CanonicalDeck deck = {};
+    for (int s = 0; s < 4; ++s) {
+        for (int r = 0; r < 13; ++r) {
+            deck.cards[s * 13 + r] = {static_cast<unsigned char>(s), static_cast<unsigned char>(r), RANK_VALUES[r]};
+        }
+    }
+    return deck;
+}
+
+constexpr CanonicalDeck CANONICAL_DECK = makeCanonicalDeck();
+static_assert(CANONICAL_DECK.cards[0].value == 11 && CANONICAL_DECK.cards[51].value == 10, "deck table");
+
+// Creates a standard 52-card deck: one copy of the canonical deck
+void createDeck(std::vector<Card>& deck) {
+    deck.assign(std::begin(CANONICAL_DECK.cards), std::end(CANONICAL_DECK.cards));
+}
+
+// Shuffles the deck randomly
+void shuffleDeck(std::vector<Card>& deck) {
+    unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
+    std::mt19937 g(seed);
+    std::shuffle(deck.begin(), deck.end(), g);
+}
+
+// Creates a shoe made of several standard decks, reusing the shoe's storage
+void createShoe(std::vector<Card>& shoe, int numDecks) {
+    shoe.resize(52 * numDecks);
+    for (int i = 0; i < numDecks; ++i) {
+        std::memcpy(shoe.data() + 52 * i, CANONICAL_DECK.cards, sizeof(CANONICAL_DECK.cards));
+    }
+}
+
+// Calculates the total value of a hand, handling Aces (1 or 11)
+int calculateHandTotal(const Hand& hand) {
+    int total = 0;
+    int aceCount = 0;
+    for (const Card& card : hand) {
+        total += card.value;
+        if (card.rank == ACE) {
+            aceCount++;
+        }
+    }
+    // Adjust Aces if total is over 21
+    while (total > 21 && aceCount > 0) {
+        total -= 10;
+        aceCount--;
+    }
+    return total;
+}
+
+// Returns true if the hand still counts an Ace as 11
+bool isSoftHand(const Hand& hand) {
+    int total = 0;
+    int aceCount = 0;
+    for (const Card& card : hand) {
+        total += card.value;
+        if (card.rank == ACE) {
+            aceCount++;
+        }
+    }
+    while (total > 21 && aceCount > 0) {
+        total -= 10;
+        aceCount--;
+    }
+    return aceCount > 0;
+}
+
+// --- Shuffle Kernel ---
+
+// xoshiro256** (Blackman and Vigna): 32 bytes of state and one 64-bit output per call
+struct Xoshiro256 {
+    typedef unsigned long long result_type;
+    unsigned long long state[4];
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~0ULL; }
+
+    // Expands one 64-bit seed into the full state with splitmix64
+    void seed(unsigned long long value) {
+        for (unsigned long long& word : state) {
+            unsigned long long z = (value += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    result_type operator()() {
+        unsigned long long result = rotl(state[1] * 5, 7) * 9;
+        unsigned long long t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+private:
+    static unsigned long long rotl(unsigned long long x, int k) { return (x << k) | (x >> (64 - k)); }
+};
+
+typedef unsigned __int128 uint128;
+
+// Fisher-Yates over a card buffer. Swap indices come from Lemire's
+// nearly-divisionless bounded random, batched so one 64-bit draw yields the
+// indices for two positions: the draw is multiplied by each bound in turn and
+// the low word left over decides rejection against their product. The modulo
+// only runs in the rare case the leftover falls below that product.
+template <typename Rng>
+void fastShuffle(Card* cards, size_t n, Rng& rng) {
+    size_t i = n;
+    while (i > 2) {
+        unsigned long long bound1 = i, bound2 = i - 1;
+        unsigned long long product = bound1 * bound2;
+        uint128 m = static_cast<uint128>(rng()) * bound1;
+        unsigned long long j1 = static_cast<unsigned long long>(m >> 64);
+        m = static_cast<uint128>(static_cast<unsigned long long>(m)) * bound2;
+        unsigned long long j2 = static_cast<unsigned long long>(m >> 64);
+        unsigned long long leftover = static_cast<unsigned long long>(m);
+        if (leftover < product) {
+            unsigned long long threshold = (0 - product) % product;
+            while (leftover < threshold) {
+                m = static_cast<uint128>(rng()) * bound1;
+                j1 = static_cast<unsigned long long>(m >> 64);
+                m = static_cast<uint128>(static_cast<unsigned long long>(m)) * bound2;
+                j2 = static_cast<unsigned long long>(m >> 64);
+                leftover = static_cast<unsigned long long>(m);
+            }
+        }
+        std::swap(cards[i - 1], cards[j1]);
+        std::swap(cards[i - 2], cards[j2]);
+        i -= 2;
+    }
+    if (i == 2) {
+        // A bound of two divides 2^64, so the top bit is exactly uniform
+        unsigned long long j = rng() >> 63;
+        std::swap(cards[1], cards[j]);
+    }
+}
+
+// A uniform draw from [0, bound) by the same multiply-and-reject as
+// fastShuffle, one bound at a time
+template <typename Rng>
+unsigned long long boundedRandom(Rng& rng, unsigned long long bound) {
+    uint128 m = static_cast<uint128>(rng()) * bound;
+    unsigned long long leftover = static_cast<unsigned long long>(m);
+    if (leftover < bound) {
+        unsigned long long threshold = (0 - bound) % bound;
+        while (leftover < threshold) {
+            m = static_cast<uint128>(rng()) * bound;
+            leftover = static_cast<unsigned long long>(m);
+        }
+    }
+    return static_cast<unsigned long long>(m >> 64);
+}
+
+// --- Shoe Pool ---
+
+// Bounded single-producer single-consumer ring. Items are swapped in and out,
+// so passing a shoe buffer through the ring never copies or allocates.
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    bool push(T& item) {
+        size_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail - headIndex.load(std::memory_order_acquire) == Capacity) return false;
+        std::swap(slots[tail & (Capacity - 1)], item);
+        tailIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == tailIndex.load(std::memory_order_acquire)) return false;
+        std::swap(item, slots[head & (Capacity - 1)]);
+        headIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    alignas(64) std::atomic<size_t> headIndex{0};
+    alignas(64) std::atomic<size_t> tailIndex{0};
+    T slots[Capacity];
+};
+
+// Counted wakeups for a thread that sleeps until another hands it work. A
+// post made before the wait is kept, so no wakeup is lost. On Linux this is
+// a semaphore and post() never blocks or takes a lock; elsewhere it falls
+// back to a counter under a mutex.
+class Wakeup {
+public:
+#ifdef WAKEUP_SEMAPHORE
+    Wakeup() { sem_init(&semaphore, 0, 0); }
+    ~Wakeup() { sem_destroy(&semaphore); }
+    void post() { sem_post(&semaphore); }
+    void wait() {
+        while (sem_wait(&semaphore) != 0) {} // Retried when a signal interrupts it
+    }
+
+private:
+    sem_t semaphore;
+#else
+    void post() {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++count;
+        posted.notify_one();
+    }
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        posted.wait(lock, [this] { return count > 0; });
+        --count;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable posted;
+    unsigned count = 0;
+#endif
+};
+
+// Keeps freshly shuffled decks ready on a background thread. Taking one swaps
+// it with the table's spent deck, whose buffer goes back to the producer to be
+// refilled, so the table never builds or shuffles a deck itself.
+class ShoePool {
+public:
+    void start(int depth = 3) {
+        std::random_device seedSource;
+        rng.seed((static_cast<unsigned long long>(seedSource()) << 32) ^ seedSource());
+        for (int i = 0; i < depth; ++i) {
+            std::vector<Card> buffer;
+            buffer.reserve(52);
+            recycled.push(buffer);
+        }
+        running.store(true);
+        producer = std::thread([this] { produce(); });
+    }
+
+    void stop() {
+        if (!producer.joinable()) return;
+        running.store(false);
+        slotFreed.post();
+        producer.join();
+    }
+
+    ~ShoePool() { stop(); }
+
+    // Swaps the next prepared deck into place; false if none is ready yet
+    bool take(std::vector<Card>& deck) {
+        std::vector<Card> next;
+        if (!ready.pop(next)) return false;
+        std::swap(deck, next);
+        recycled.push(next);
+        slotFreed.post();
+        return true;
+    }
+
+private:
+    // Sleeps until a spent buffer comes back or a ready slot frees up. Each
+    // take() posts after it touches the rings, so a post that lands between
+    // a failed check and the wait just makes the wait return at once.
+    void produce() {
+        std::vector<Card> buffer;
+        while (running.load()) {
+            if (buffer.capacity() == 0 && !recycled.pop(buffer)) {
+                slotFreed.wait();
+                continue;
+            }
+            if (buffer.size() < 52) {
+                createDeck(buffer);
+                fastShuffle(buffer.data(), buffer.size(), rng);
+            }
+            if (ready.push(buffer)) {
+                buffer = std::vector<Card>();
+            } else {
+                slotFreed.wait();
+            }
+        }
+    }
+
+    SpscRing<std::vector<Card>, 4> ready;
+    SpscRing<std::vector<Card>, 4> recycled;
+    std::thread producer;
+    Wakeup slotFreed; // The table took a deck and returned a buffer
+    std::atomic<bool> running{false};
+    Xoshiro256 rng;
+};
+
+// --- Round Rules (shared by the table and the simulator) ---
+// A rule set is either a RulePolicy, whose members are compile-time constants,
+// or a RuntimeRules value read from the command line. Round code is templated
+// on the rule type and reads rules.x either way, so a policy instantiation
+// folds every rule check away while RuntimeRules covers any other table.
+
+template <bool HitSoft17, int BlackjackNum, int BlackjackDen, int ReshuffleBelow, int MaxSeats>
+struct RulePolicy {
+    static constexpr bool hitSoft17 = HitSoft17;         // Dealer hits a soft 17
+    static constexpr int blackjackNum = BlackjackNum;    // Blackjack pays Num:Den
+    static constexpr int blackjackDen = BlackjackDen;
+    static constexpr int reshuffleBelow = ReshuffleBelow; // Cards left that trigger a reshuffle
+    static constexpr int maxSeats = MaxSeats;
+};
+
+struct RuntimeRules {
+    bool hitSoft17 = false;
+    int blackjackNum = 3;
+    int blackjackDen = 2;
+    int reshuffleBelow = 20;
+    int maxSeats = 7;
+};
+
+// The rules of the interactive table
+typedef RulePolicy<false, 3, 2, 20, 7> TableRules;
+
+template <typename Rules>
+RuntimeRules runtimeRulesOf(const Rules& rules) {
+    RuntimeRules r;
+    r.hitSoft17 = rules.hitSoft17;
+    r.blackjackNum = rules.blackjackNum;
+    r.blackjackDen = rules.blackjackDen;
+    r.reshuffleBelow = rules.reshuffleBelow;
+    r.maxSeats = rules.maxSeats;
+    return r;
+}
+
+bool sameRules(const RuntimeRules& a, const RuntimeRules& b) {
+    return a.hitSoft17 == b.hitSoft17 && a.blackjackNum == b.blackjackNum && a.blackjackDen == b.blackjackDen &&
+           a.reshuffleBelow == b.reshuffleBelow && a.maxSeats == b.maxSeats;
+}
+
+std::string describeRules(const RuntimeRules& rules) {
+    return std::string(rules.hitSoft17 ? "H17" : "S17") + ", Blackjack pays " + std::to_string(rules.blackjackNum) +
+           ":" + std::to_string(rules.blackjackDen) + ", reshuffle below " + std::to_string(rules.reshuffleBelow);
+}
+
+// Resolves a freshly dealt hand against a possible dealer Blackjack
+PlayerStatus initialStatus(int playerTotal, bool dealerHasBJ) {
+    if (playerTotal == 21) {
+        return dealerHasBJ ? STANDING : BLACKJACK; // Both Blackjack is a push
+    }
+    return dealerHasBJ ? BUSTED : PLAYING;
+}
+
+// Dealer draws to 17; whether a soft 17 stands is up to the rules
+template <typename Rules = TableRules>
+bool dealerShouldHit(const Hand& dealerHand, const Rules& rules = Rules()) {
+    int total = calculateHandTotal(dealerHand);
+    return total < 17 || (rules.hitSoft17 && total == 17 && isSoftHand(dealerHand));
+}
+
+// Returns the change in a player's balance once the round is over
+template <typename Rules = TableRules>
+Money settleBet(PlayerStatus status, Money bet, int playerTotal, int dealerTotal, bool dealerBusted,
+                const Rules& rules = Rules()) {
+    switch (status) {
+        case BLACKJACK:
+            return bet.scaled(rules.blackjackNum, rules.blackjackDen);
+        case BUSTED:
+            return -bet;
+        case STANDING:
+            if (dealerBusted || playerTotal > dealerTotal) return bet;
+            if (playerTotal < dealerTotal) return -bet;
+            return Money();
+        default:
+            return Money();
+    }
+}
+
+// Prints a player's hand to the console
+void printHand(const std::string& name, const Hand& hand, bool isDealerHidden = false) {
+    PROFILE_PHASE(PHASE_RENDERING);
+    std::cout << name << "'s hand: ";
+    if (isDealerHidden) {
+        std::cout << "[HIDDEN CARD] ";
+        std::cout << RANK_NAMES[hand[1].rank] << " of " << SUIT_NAMES[hand[1].suit] << std::endl;
+    } else {
+        for (const Card& card : hand) {
+            std::cout << RANK_NAMES[card.rank] << " of " << SUIT_NAMES[card.suit] << " | ";
+        }
+        std::cout << "Total: " << calculateHandTotal(hand) << std::endl;
+    }
+}
+
+// Checks once per round whether the shoe has reached the cut card and
+// recreates it if so. Without announce the table message and pause are
+// skipped. With a pool the new deck is a prepared one swapped in; building
+// it here is only the fallback.
+void checkDeck(std::vector<Card>& deck, bool announce = true, ShoePool* pool = nullptr) {
+    if (deck.size() < TableRules::reshuffleBelow) { 
+        if (announce) {
+            std::cout << "\n--- Deck is running low! Creating and shuffling a new deck... ---\n" << std::endl;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+        }
+        if (pool == nullptr || !pool->take(deck)) {
+            createDeck(deck);
+            shuffleDeck(deck);
+        }
+        addMetric(METRIC_RESHUFFLES);
+    }
+}
+
+// Emergency refill when the shoe cannot cover a deal mid-round: a fresh deck
+// goes in beneath the cards still left, which are dealt first
+void refillShoe(std::vector<Card>& deck, ShoePool* pool = nullptr, bool announce = true) {
+    if (announce) {
+        std::cout << "\n--- The shoe ran out mid-round! Adding a fresh deck... ---\n" << std::endl;
+    }
+    std::vector<Card> fresh;
+    if (pool == nullptr || !pool->take(fresh)) {
+        createDeck(fresh);
+        shuffleDeck(fresh);
+    }
+    fresh.insert(fresh.end(), deck.begin(), deck.end());
+    deck.swap(fresh);
+    addMetric(METRIC_RESHUFFLES);
+}
+
+// Deals a single card from the deck. The cut card is checked per round, so
+// only an empty shoe needs attention here.
+Card dealCard(std::vector<Card>& deck, ShoePool* pool = nullptr, bool announce = true) {
+    if (deck.empty()) refillShoe(deck, pool, announce);
+    Card drawnCard = deck.back();
+    deck.pop_back();
+    return drawnCard;
+}
+
+// Deals the opening two cards to the seats in mask and to the dealer, in
+// table order, from one contiguous slice off the top (back) of the shoe
+void dealInitialCards(std::vector<Card>& deck, SeatTable& table, unsigned mask, int seatCount, Hand& dealerHand,
+                      ShoePool* pool = nullptr, bool announce = true) {
+    size_t needed = 2 * (static_cast<size_t>(seatCount) + 1);
+    while (deck.size() < needed) refillShoe(deck, pool, announce);
+    const Card* next = deck.data() + deck.size();
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int seat : table.seats(mask)) table.hands[seat].push_back(*--next);
+        dealerHand.push_back(*--next);
+    }
+    deck.resize(deck.size() - needed);
+}
+
+// Clears the input buffer to prevent skipping inputs
+void clearInputBuffer() {
+    std::cin.clear();
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+}
+
+// --- Side Bets ---
+// Both side bets settle off the player's first two cards, 21+3 adding the
+// dealer upcard. A card's compact code is suit * 13 + rank, and every code
+// pair and triple has its result in a table, so settling is one lookup.
+
+const int CARD_CODES = 52;
+
+inline int cardCode(const Card& card) {
+    return card.suit * 13 + card.rank;
+}
+
+enum PairResult { PAIR_NONE, PAIR_MIXED, PAIR_COLORED, PAIR_PERFECT };
+const char* const PAIR_NAMES[] = {"No pair", "Mixed pair", "Colored pair", "Perfect pair"};
+const int PAIR_PAYS[] = {-1, 6, 12, 25}; // Net units won per unit bet
+
+enum ThreeCardResult { THREE_NONE, THREE_FLUSH, THREE_STRAIGHT, THREE_TRIPS, THREE_STRAIGHT_FLUSH, THREE_SUITED_TRIPS };
+const char* const THREE_CARD_NAMES[] = {"Nothing", "Flush", "Straight", "Three of a kind", "Straight flush", "Suited trips"};
+const int THREE_CARD_PAYS[] = {-1, 5, 10, 30, 40, 100};
+
+// Hearts and Diamonds are red, Spades and Clubs black
+constexpr bool sameColor(int suitA, int suitB) {
+    return suitA % 2 == suitB % 2;
+}
+
+// Tables classified at compile time: every code pair, and every rank triple
+// as if the three cards were not all one suit
+struct SideBetTables {
+    unsigned char pairs[CARD_CODES * CARD_CODES] = {};
+    unsigned char rankTriples[13 * 13 * 13] = {};
+
+    constexpr SideBetTables() {
+        for (int a = 0; a < CARD_CODES; ++a) {
+            for (int b = 0; b < CARD_CODES; ++b) pairs[a * CARD_CODES + b] = classifyPair(a, b);
+        }
+        for (int a = 0; a < 13; ++a) {
+            for (int b = 0; b < 13; ++b) {
+                for (int c = 0; c < 13; ++c) rankTriples[(a * 13 + b) * 13 + c] = classifyRanks(a, b, c);
+            }
+        }
+    }
+
+    static constexpr unsigned char classifyPair(int a, int b) {
+        if (a % 13 != b % 13) return PAIR_NONE;
+        if (a == b) return PAIR_PERFECT;
+        return sameColor(a / 13, b / 13) ? PAIR_COLORED : PAIR_MIXED;
+    }
+
+    static constexpr unsigned char classifyRanks(int a, int b, int c) {
+        int ranks[3] = {a, b, c};
+        for (int i = 1; i < 3; ++i) {
+            for (int j = i; j > 0 && ranks[j - 1] > ranks[j]; --j) {
+                int t = ranks[j];
+                ranks[j] = ranks[j - 1];
+                ranks[j - 1] = t;
+            }
+        }
+        if (ranks[0] == ranks[2]) return THREE_TRIPS;
+        bool distinct = ranks[0] != ranks[1] && ranks[1] != ranks[2];
+        // Aces play low (A-2-3) or high (Q-K-A)
+        bool straight = distinct && (ranks[2] - ranks[0] == 2 || (ranks[0] == ACE && ranks[1] == 11 && ranks[2] == 12));
+        return straight ? THREE_STRAIGHT : THREE_NONE;
+    }
+
+    // The same ranks when all three cards share a suit
+    static constexpr unsigned char suited(unsigned char result) {
+        return result == THREE_TRIPS ? THREE_SUITED_TRIPS : result == THREE_STRAIGHT ? THREE_STRAIGHT_FLUSH : THREE_FLUSH;
+    }
+};
+
+constexpr SideBetTables SIDE_BET_TABLES;
+
+// Every code triple for 21+3. At 52^3 entries this is too large to evaluate
+// at compile time without slowing every build, so it is filled once at
+// startup: each (first, second) row is the 13-entry rank row copied for the
+// four upcard suits, with the suited version written over the one suit that
+// can make a flush.
+struct ThreeCardTable {
+    unsigned char results[CARD_CODES * CARD_CODES * CARD_CODES];
+
+    ThreeCardTable() {
+        for (int a = 0; a < CARD_CODES; ++a) {
+            for (int b = 0; b < CARD_CODES; ++b) {
+                unsigned char* row = results + (a * CARD_CODES + b) * CARD_CODES;
+                const unsigned char* ranks = SIDE_BET_TABLES.rankTriples + (a % 13 * 13 + b % 13) * 13;
+                for (int suit = 0; suit < 4; ++suit) std::memcpy(row + suit * 13, ranks, 13);
+                if (a / 13 == b / 13) {
+                    for (int rank = 0; rank < 13; ++rank) row[a / 13 * 13 + rank] = SideBetTables::suited(ranks[rank]);
+                }
+            }
+        }
+    }
+};
+
+const ThreeCardTable THREE_CARD_TABLE;
+
+inline PairResult pairResult(const Card& first, const Card& second) {
+    return static_cast<PairResult>(SIDE_BET_TABLES.pairs[cardCode(first) * CARD_CODES + cardCode(second)]);
+}
+
+inline ThreeCardResult threeCardResult(const Card& first, const Card& second, const Card& upcard) {
+    return static_cast<ThreeCardResult>(
+        THREE_CARD_TABLE.results[(cardCode(first) * CARD_CODES + cardCode(second)) * CARD_CODES + cardCode(upcard)]);
+}
+
+struct SideBetOdds {
+    double pair[4];       // Probability of each PairResult
+    double threeCard[6];  // Probability of each ThreeCardResult
+    double pairEv = 0.0;  // Expected net units per unit bet
+    double threeCardEv = 0.0;
+};
+
+// Exact odds on a fresh shoe: enumerates every ordered deal of the two or
+// three cards involved, weighted by how many ways the shoe can produce it
+SideBetOdds exactSideBetOdds(int decks) {
+    SideBetOdds odds = {};
+    double n = CARD_CODES * static_cast<double>(decks);
+    for (int a = 0; a < CARD_CODES; ++a) {
+        for (int b = 0; b < CARD_CODES; ++b) {
+            double ab = decks * static_cast<double>(decks - (a == b));
+            odds.pair[SIDE_BET_TABLES.pairs[a * CARD_CODES + b]] += ab / (n * (n - 1));
+            for (int c = 0; c < CARD_CODES; ++c) {
+                double abc = ab * (decks - (a == c) - (b == c));
+                odds.threeCard[THREE_CARD_TABLE.results[(a * CARD_CODES + b) * CARD_CODES + c]] +=
+                    abc / (n * (n - 1) * (n - 2));
+            }
+        }
+    }
+    for (int r = 0; r < 4; ++r) odds.pairEv += odds.pair[r] * PAIR_PAYS[r];
+    for (int r = 0; r < 6; ++r) odds.threeCardEv += odds.threeCard[r] * THREE_CARD_PAYS[r];
+    return odds;
+}
+
+// Asks for an optional side bet of at most maxBet whole dollars; 0 declines it
+Money promptSideBet(const char* name, long long maxBet) {
+    while (true) {
+        long long bet = 0;
+        std::cout << name << " side bet (0 for none, Max " << maxBet << "): ";
+        std::cin >> bet;
+        if (std::cin.fail()) {
+            std::cout << "Please enter a valid number." << std::endl;
+            clearInputBuffer();
+        } else if (bet < 0 || bet > maxBet) {
+            std::cout << "Invalid side bet." << std::endl;
+        } else {
+            return Money::dollars(bet);
+        }
+    }
+}
+
+// Prints the exact odds and house edge of both side bets; decks 0 lists the common shoes
+int runSideBetOdds(int decks) {
+    std::vector<int> shoes = decks > 0 ? std::vector<int>{decks} : std::vector<int>{1, 2, 4, 6, 8};
+    std::cout << std::fixed;
+    for (int d : shoes) {
+        SideBetOdds odds = exactSideBetOdds(d);
+        std::cout << "--- SIDE BETS, " << d << " DECK(S) ---" << std::endl;
+        std::cout.precision(6);
+        for (int r = 3; r >= 1; --r) {
+            std::cout << "  Perfect Pairs " << PAIR_NAMES[r] << " (" << PAIR_PAYS[r] << ":1): " << odds.pair[r] << std::endl;
+        }
+        for (int r = 5; r >= 1; --r) {
+            std::cout << "  21+3 " << THREE_CARD_NAMES[r] << " (" << THREE_CARD_PAYS[r] << ":1): " << odds.threeCard[r]
+                      << std::endl;
+        }
+        std::cout.precision(3);
+        std::cout << "Perfect Pairs house edge: " << -100.0 * odds.pairEv << "%" << std::endl;
+        std::cout << "21+3 house edge: " << -100.0 * odds.threeCardEv << "%" << std::endl;
+    }
+    return 0;
+}
+
+// --- Allocation Tracking ---
+
+// Heap allocations made by the current thread, counted by the global operator new
+thread_local unsigned long long threadAllocations = 0;
+
+// All three are kept out of line: once inlined, GCC pairs the malloc() or
+// free() with the builtin operator new/delete and reports a false mismatch
+__attribute__((noinline)) void* operator new(std::size_t size) {
+    threadAllocations++;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+// --- Simulation Records ---
+// Per-hand simulation records are buffered per thread in fixed-size column
+// batches. A full batch goes to a writer thread in exchange for an empty one,
+// so workers only hold a lock long enough to swap pointers, never during I/O.
+//
+// Binary layout (little-endian): an 8-byte magic "BJREC001", a u32 column
+// count, then per column a 16-byte NUL-padded name and a u8 type (1 = u8,
+// 2 = f32). Each batch follows as "BTCH", a u32 row count, and the columns
+// back to back, one contiguous array per column.
+
+enum RoundOutcome {
+    OUTCOME_BLACKJACK,        // Paid 3:2
+    OUTCOME_BLACKJACK_PUSH,   // Both had Blackjack
+    OUTCOME_DEALER_BLACKJACK, // Lost to the dealer's Blackjack
+    OUTCOME_BUSTED,
+    OUTCOME_WON,
+    OUTCOME_LOST,
+    OUTCOME_PUSH
+};
+
+const char* const OUTCOME_NAMES[] = {"blackjack", "blackjack_push", "dealer_blackjack", "busted", "won", "lost", "push"};
+
+const int RECORD_BATCH_ROWS = 1 << 16;
+
+struct RecordBatch {
+    int rows = 0;
+    unsigned char upcard[RECORD_BATCH_ROWS];
+    unsigned char initialTotal[RECORD_BATCH_ROWS];
+    unsigned char finalTotal[RECORD_BATCH_ROWS];
+    unsigned char dealerTotal[RECORD_BATCH_ROWS];
+    unsigned char hits[RECORD_BATCH_ROWS];
+    unsigned char outcome[RECORD_BATCH_ROWS];
+    float payout[RECORD_BATCH_ROWS];
+    float trueCount[RECORD_BATCH_ROWS];
+};
+
+class RecordWriter {
+public:
+    // Opens the output; csv selects the text fallback
+    bool open(const std::string& path, bool csvFormat, int producers) {
+        file = std::fopen(path.c_str(), csvFormat ? "w" : "wb");
+        if (file == nullptr) return false;
+        csv = csvFormat;
+        maxBatches = 2 * producers + 2;
+        writeHeader();
+        worker = std::thread([this] { run(); });
+        return true;
+    }
+
+    // Returns an empty batch, waiting if every batch is still queued for writing
+    RecordBatch* acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        batchFreed.wait(lock, [this] { return !freeBatches.empty() || allocated < maxBatches; });
+        if (!freeBatches.empty()) {
+            RecordBatch* batch = freeBatches.back();
+            freeBatches.pop_back();
+            return batch;
+        }
+        allocated++;
+        return new RecordBatch();
+    }
+
+    void submit(RecordBatch* batch) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fullBatches.push_back(batch);
+        }
+        batchQueued.notify_one();
+    }
+
+    // Writes everything still queued, then closes the file
+    void close() {
+        if (!worker.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        batchQueued.notify_one();
+        worker.join();
+        std::fclose(file);
+        for (RecordBatch* batch : freeBatches) delete batch;
+        freeBatches.clear();
+    }
+
+    ~RecordWriter() { close(); }
+
+    long long rowsWritten() const { return rows; }
+
+private:
+    // Both formats carry the same columns under the same names
+    void writeHeader() {
+        static const char* const names[] = {"upcard", "initial_total", "final_total", "dealer_total",
+                                            "hits", "outcome", "payout", "true_count"};
+        if (csv) {
+            for (int c = 0; c < 8; ++c) {
+                std::fputs(names[c], file);
+                std::fputc(c < 7 ? ',' : '\n', file);
+            }
+            return;
+        }
+        std::fwrite("BJREC001", 1, 8, file);
+        unsigned columns = 8;
+        std::fwrite(&columns, sizeof(columns), 1, file);
+        for (int c = 0; c < 8; ++c) {
+            char name[16] = {};
+            std::strncpy(name, names[c], sizeof(name) - 1);
+            unsigned char type = c < 6 ? 1 : 2;
+            std::fwrite(name, 1, sizeof(name), file);
+            std::fwrite(&type, 1, 1, file);
+        }
+    }
+
+    void writeBatch(const RecordBatch& b) {
+        rows += b.rows;
+        if (csv) {
+            char line[96];
+            for (int r = 0; r < b.rows; ++r) {
+                int len = std::snprintf(line, sizeof(line), "%d,%d,%d,%d,%d,%s,%g,%.3f\n", b.upcard[r], b.initialTotal[r],
+                                        b.finalTotal[r], b.dealerTotal[r], b.hits[r], OUTCOME_NAMES[b.outcome[r]],
+                                        b.payout[r], b.trueCount[r]);
+                std::fwrite(line, 1, len, file);
+            }
+            return;
+        }
+        unsigned count = static_cast<unsigned>(b.rows);
+        std::fwrite("BTCH", 1, 4, file);
+        std::fwrite(&count, sizeof(count), 1, file);
+        std::fwrite(b.upcard, 1, count, file);
+        std::fwrite(b.initialTotal, 1, count, file);
+        std::fwrite(b.finalTotal, 1, count, file);
+        std::fwrite(b.dealerTotal, 1, count, file);
+        std::fwrite(b.hits, 1, count, file);
+        std::fwrite(b.outcome, 1, count, file);
+        std::fwrite(b.payout, sizeof(float), count, file);
+        std::fwrite(b.trueCount, sizeof(float), count, file);
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            batchQueued.wait(lock, [this] { return !fullBatches.empty() || closing; });
+            if (fullBatches.empty()) return;
+            RecordBatch* batch = fullBatches.front();
+            fullBatches.erase(fullBatches.begin());
+            lock.unlock();
+            writeBatch(*batch);
+            batch->rows = 0;
+            lock.lock();
+            freeBatches.push_back(batch);
+            batchFreed.notify_one();
+        }
+    }
+
+    std::FILE* file = nullptr;
+    bool csv = false;
+    int maxBatches = 4;
+    int allocated = 0;
+    long long rows = 0;
+    bool closing = false;
+    std::vector<RecordBatch*> fullBatches;
+    std::vector<RecordBatch*> freeBatches;
+    std::mutex mutex;
+    std::condition_variable batchQueued;
+    std::condition_variable batchFreed;
+    std::thread worker;
+};
+
+// One worker thread's open batch
+class RecordBuffer {
+public:
+    explicit RecordBuffer(RecordWriter* writer) : writer(writer), batch(writer ? writer->acquire() : nullptr) {}
+    ~RecordBuffer() {
+        if (batch != nullptr) writer->submit(batch); // Partial last batch
+    }
+
+    void add(int upcard, int initialTotal, int finalTotal, int dealerTotal, int hits, RoundOutcome outcome,
+             double payout, double trueCount) {
+        int r = batch->rows++;
+        batch->upcard[r] = static_cast<unsigned char>(upcard);
+        batch->initialTotal[r] = static_cast<unsigned char>(initialTotal);
+        batch->finalTotal[r] = static_cast<unsigned char>(finalTotal);
+        batch->dealerTotal[r] = static_cast<unsigned char>(dealerTotal);
+        batch->hits[r] = static_cast<unsigned char>(hits);
+        batch->outcome[r] = static_cast<unsigned char>(outcome);
+        batch->payout[r] = static_cast<float>(payout);
+        batch->trueCount[r] = static_cast<float>(trueCount);
+        if (batch->rows == RECORD_BATCH_ROWS) {
+            writer->submit(batch);
+            batch = writer->acquire();
+        }
+    }
+
+private:
+    RecordWriter* writer;
+    RecordBatch* batch;
+};
+
+// --- Headless Simulation ---
+
+enum Strategy {
+    STRATEGY_DEALER,     // Mimics the dealer: hit below 17
+    STRATEGY_NEVER_BUST, // Only hits when a card cannot bust the hand
+    STRATEGY_BASIC       // Hit/stand basic strategy (the table offers no doubles or splits)
+};
+
+struct SimConfig {
+    Strategy strategy = STRATEGY_BASIC;
+    Strategy otherStrategy = STRATEGY_DEALER;
+    long long hands = 1000000;
+    int decks = 1;
+    int roundsPerTrial = 0; // 0 picks the mode default
+    unsigned seed = 1;
+    int threads = 0;
+    bool antithetic = false;
+    std::string recordsPath;  // Per-hand records from --simulate; empty for none
+    bool recordsCsv = false;
+    RuntimeRules rules;
+    bool sideBets = false;    // Also place unit Perfect Pairs and 21+3 bets
+};
+
+// A shoe reused by one simulation worker, reshuffled from its own generator.
+// Dealt cards stay in the buffer past 'remaining', so a reshuffle only has to
+// permute the buffer again; the composition never changes.
+struct SimShoe {
+    std::vector<Card> cards;
+    int remaining = 0;
+    Xoshiro256 rng;
+    int decks = 1;
+    int runningCount = 0;    // Hi-Lo count of the cards dealt since the shuffle
+    int roundStart = 0;      // remaining when the current round began; cards above it are in play
+};
+
+// Hi-Lo tags indexed by card value: 2-6 count +1, tens and Aces -1
+const int HI_LO[12] = {0, 0, 1, 1, 1, 1, 1, 0, 0, 0, -1, -1};
+
+// Per-round state of a simulated seat. It lives with the worker and is reset
+// every round, so a steady-state round performs no heap allocation.
+struct SimRound {
+    Hand hand;
+    Hand dealerHand;
+    InlineVector<char, MAX_HAND_CARDS> actions; // 'H' hit, 'S' stand
+    PlayerStatus status = PLAYING;
+    bool dealerHasBJ = false;
+    double trueCount = 0.0; // Hi-Lo true count when the round started
+
+    void reset() {
+        hand.clear();
+        dealerHand.clear();
+        actions.clear();
+    }
+};
+
+// Running sums for a sample mean and its confidence interval
+struct RunningStats {
+    long long n = 0;
+    double sum = 0.0;
+    double sumSq = 0.0;
+
+    void add(double x) {
+        n++;
+        sum += x;
+        sumSq += x * x;
+    }
+    void merge(const RunningStats& other) {
+        n += other.n;
+        sum += other.sum;
+        sumSq += other.sumSq;
+    }
+    double mean() const { return n > 0 ? sum / n : 0.0; }
+    double variance() const {
+        if (n < 2) return 0.0;
+        double m = mean();
+        return std::max(0.0, (sumSq - n * m * m) / (n - 1));
+    }
+    double stdError() const { return n > 0 ? std::sqrt(variance() / n) : 0.0; }
+};
+
+const char* strategyName(Strategy strategy) {
+    switch (strategy) {
+        case STRATEGY_DEALER: return "dealer";
+        case STRATEGY_NEVER_BUST: return "never-bust";
+        default: return "basic";
+    }
+}
+
+bool parseStrategy(const std::string& name, Strategy& strategy) {
+    if (name == "dealer") strategy = STRATEGY_DEALER;
+    else if (name == "never-bust") strategy = STRATEGY_NEVER_BUST;
+    else if (name == "basic") strategy = STRATEGY_BASIC;
+    else return false;
+    return true;
+}
+
+// Decides whether a simulated hand takes another card
+bool shouldHit(Strategy strategy, int total, bool soft, int upcard) {
+    switch (strategy) {
+        case STRATEGY_DEALER:
+            return total < 17;
+        case STRATEGY_NEVER_BUST:
+            return total <= 11 || (soft && total < 18);
+        default:
+            if (soft) {
+                return total <= 17 || (total == 18 && upcard >= 9);
+            }
+            if (total <= 11) return true;
+            if (total == 12) return upcard < 4 || upcard > 6;
+            if (total <= 16) return upcard >= 7;
+            return false;
+    }
+}
+
+void reshuffleSimShoe(SimShoe& shoe) {
+    fastShuffle(shoe.cards.data(), shoe.cards.size(), shoe.rng);
+    shoe.remaining = static_cast<int>(shoe.cards.size());
+    shoe.runningCount = 0;
+    shoe.roundStart = shoe.remaining;
+}
+
+// The cut-card check, made once per round before the deal like the table's checkDeck
+template <typename Rules = TableRules>
+void startSimRound(SimShoe& shoe, const Rules& rules = Rules()) {
+    if (shoe.remaining < rules.reshuffleBelow) {
+        reshuffleSimShoe(shoe);
+    }
+    shoe.roundStart = shoe.remaining;
+}
+
+// Refills a shoe that ran dry mid-round from the discards alone, so no card
+// in play can be dealt twice. Only a round that used every card in the shoe
+// (the solver's smallest shoes) falls back to reshuffling all of it.
+void refillSimShoe(SimShoe& shoe) {
+    const int size = static_cast<int>(shoe.cards.size());
+    const int discards = size - shoe.roundStart;
+    if (discards == 0) {
+        reshuffleSimShoe(shoe);
+        return;
+    }
+    // Discards move to the front and are shuffled; the cards in play stay above them
+    std::rotate(shoe.cards.begin(), shoe.cards.begin() + shoe.roundStart, shoe.cards.end());
+    fastShuffle(shoe.cards.data(), discards, shoe.rng);
+    shoe.remaining = discards;
+    shoe.roundStart = size;
+    shoe.runningCount = 0;
+    for (int k = discards; k < size; ++k) shoe.runningCount += HI_LO[shoe.cards[k].value];
+}
+
+// Each rank's reflection around the Hi-Lo count: 2<->A, 3<->K, 4<->Q, 5<->J
+// and 6<->10, with 7-9 fixed. Every +1 card trades places with a -1 card.
+const int MIRROR_RANK[13] = {1, 0, 12, 11, 10, 9, 6, 7, 8, 5, 4, 3, 2};
+
+// Cards of the opening deal, which a mirrored shoe leaves in place
+const int OPENING_CARDS = 4;
+
+// Turns a freshly shuffled shoe into its antithetic partner. The opening
+// deal stays, so both trials face the same first decision; below it each
+// card becomes its reflection, so a hit that drew a low card draws a high
+// one and the outcome of hitting versus standing flips. A card and its
+// reflection are swapped only when the rest of the shoe holds as many of
+// one as of the other, which makes the relabeling a bijection of that rest:
+// the partner is itself a uniformly shuffled shoe.
+void mirrorSimShoe(SimShoe& shoe) {
+    const int rest = shoe.remaining - OPENING_CARDS;
+    int counts[CARD_CODES] = {};
+    for (int k = 0; k < rest; ++k) counts[cardCode(shoe.cards[k])]++;
+    for (int k = 0; k < rest; ++k) {
+        int code = cardCode(shoe.cards[k]);
+        int reflected = code / 13 * 13 + MIRROR_RANK[code % 13];
+        if (counts[code] == counts[reflected]) shoe.cards[k] = CANONICAL_DECK.cards[reflected];
+    }
+}
+
+// Reseeds the worker's shoe for a trial and shuffles it fresh from deck
+// order. A mirrored trial draws the same shuffle and then mirrors it.
+void startSimTrial(SimShoe& shoe, const SimConfig& cfg, long long trial, bool mirror) {
+    shoe.rng.seed((static_cast<unsigned long long>(cfg.seed) << 32) ^ static_cast<unsigned long long>(trial) * 0xD1B54A32D192ED03ULL);
+    shoe.decks = cfg.decks;
+    createShoe(shoe.cards, shoe.decks);
+    reshuffleSimShoe(shoe);
+    if (mirror) mirrorSimShoe(shoe);
+}
+
+// Quiet counterpart of dealCard: only an empty shoe is refilled mid-round
+inline Card drawSimCard(SimShoe& shoe) {
+    if (shoe.remaining == 0) {
+        refillSimShoe(shoe);
+    }
+    const Card& card = shoe.cards[--shoe.remaining];
+    shoe.runningCount += HI_LO[card.value];
+    return card;
+}
+
+// Plays one headless round for a single seat and returns the net result in
+// bets. hit(total, soft, upcard) makes each decision.
+template <typename Rules, typename Decide>
+double playSimRoundWith(SimShoe& shoe, SimRound& round, Decide hit, const Rules& rules) {
+    round.reset();
+    startSimRound(shoe, rules);
+    round.trueCount = shoe.runningCount * 52.0 / std::max(shoe.remaining, 1);
+    Hand& hand = round.hand;
+    Hand& dealerHand = round.dealerHand;
+    hand.push_back(drawSimCard(shoe));
+    dealerHand.push_back(drawSimCard(shoe));
+    hand.push_back(drawSimCard(shoe));
+    dealerHand.push_back(drawSimCard(shoe));
+
+    bool dealerHasBJ = (calculateHandTotal(dealerHand) == 21);
+    PlayerStatus status = initialStatus(calculateHandTotal(hand), dealerHasBJ);
+    int upcard = dealerHand[1].value;
+
+    while (status == PLAYING) {
+        if (hit(calculateHandTotal(hand), isSoftHand(hand), upcard)) {
+            round.actions.push_back('H');
+            hand.push_back(drawSimCard(shoe));
+            if (calculateHandTotal(hand) > 21) status = BUSTED;
+        } else {
+            round.actions.push_back('S');
+            status = STANDING;
+        }
+    }
+
+    bool dealerBusted = false;
+    if (status == STANDING) {
+        while (dealerShouldHit(dealerHand, rules)) {
+            dealerHand.push_back(drawSimCard(shoe));
+        }
+        dealerBusted = calculateHandTotal(dealerHand) > 21;
+    }
+    round.status = status;
+    round.dealerHasBJ = dealerHasBJ;
+
+    // A bet of the payout denominator in cents keeps any Blackjack payout exact
+    const Money bet = Money::fromCents(rules.blackjackDen);
+    return settleBet(status, bet, calculateHandTotal(hand), calculateHandTotal(dealerHand), dealerBusted, rules)
+               .inCents() /
+           static_cast<double>(rules.blackjackDen);
+}
+
+template <typename Rules = TableRules>
+double playSimRound(SimShoe& shoe, SimRound& round, Strategy strategy, const Rules& rules = Rules()) {
+    return playSimRoundWith(
+        shoe, round, [strategy](int total, bool soft, int upcard) { return shouldHit(strategy, total, soft, upcard); },
+        rules);
+}
+
+RoundOutcome simRoundOutcome(const SimRound& round, double payout) {
+    switch (round.status) {
+        case BLACKJACK: return OUTCOME_BLACKJACK;
+        case BUSTED: return round.dealerHasBJ ? OUTCOME_DEALER_BLACKJACK : OUTCOME_BUSTED;
+        default:
+            if (round.dealerHasBJ) return OUTCOME_BLACKJACK_PUSH;
+            return payout > 0.0 ? OUTCOME_WON : (payout < 0.0 ? OUTCOME_LOST : OUTCOME_PUSH);
+    }
+}
+
+void recordSimRound(RecordBuffer& records, const SimRound& round, double payout) {
+    Hand initial;
+    initial.push_back(round.hand[0]);
+    initial.push_back(round.hand[1]);
+    int hits = 0;
+    for (char action : round.actions) {
+        if (action == 'H') hits++;
+    }
+    records.add(round.dealerHand[1].value, calculateHandTotal(initial), calculateHandTotal(round.hand),
+                calculateHandTotal(round.dealerHand), hits, simRoundOutcome(round, payout), payout, round.trueCount);
+}
+
+// Side bet results per unit bet, gathered by one worker
+struct SideBetTally {
+    RunningStats pairs;
+    RunningStats threeCard;
+
+    void add(const SimRound& round) {
+        pairs.add(PAIR_PAYS[pairResult(round.hand[0], round.hand[1])]);
+        threeCard.add(THREE_CARD_PAYS[threeCardResult(round.hand[0], round.hand[1], round.dealerHand[1])]);
+    }
+
+    void merge(const SideBetTally& other) {
+        pairs.merge(other.pairs);
+        threeCard.merge(other.threeCard);
+    }
+};
+
+// Plays a trial of rounds starting from a freshly shuffled shoe
+template <typename Rules>
+double playRulesTrial(const Rules& rules, const SimConfig& cfg, Strategy strategy, long long trial, bool mirror,
+                      SimShoe& shoe, SimRound& round, RecordBuffer* records, SideBetTally* sideBets) {
+    startSimTrial(shoe, cfg, trial, mirror);
+    double net = 0.0;
+    for (int r = 0; r < cfg.roundsPerTrial; ++r) {
+        double payout = playSimRound(shoe, round, strategy, rules);
+        net += payout;
+        if (records != nullptr) recordSimRound(*records, round, payout);
+        if (sideBets != nullptr) sideBets->add(round);
+    }
+    return net;
+}
+
+typedef double (*SimTrialFn)(const SimConfig&, Strategy, long long, bool, SimShoe&, SimRound&, RecordBuffer*,
+                             SideBetTally*);
+
+template <typename Policy>
+double playPolicyTrial(const SimConfig& cfg, Strategy strategy, long long trial, bool mirror,
+                       SimShoe& shoe, SimRound& round, RecordBuffer* records, SideBetTally* sideBets) {
+    return playRulesTrial(Policy(), cfg, strategy, trial, mirror, shoe, round, records, sideBets);
+}
+
+// Generic path for rule sets without a specialization
+double playRuntimeTrial(const SimConfig& cfg, Strategy strategy, long long trial, bool mirror,
+                        SimShoe& shoe, SimRound& round, RecordBuffer* records, SideBetTally* sideBets) {
+    return playRulesTrial(cfg.rules, cfg, strategy, trial, mirror, shoe, round, records, sideBets);
+}
+
+// Single rounds, for callers that decide between rounds (bankroll sessions)
+typedef double (*SimRoundFn)(const SimConfig&, SimShoe&, SimRound&, Strategy);
+
+template <typename Policy>
+double playPolicyRound(const SimConfig&, SimShoe& shoe, SimRound& round, Strategy strategy) {
+    return playSimRound(shoe, round, strategy, Policy());
+}
+
+double playRuntimeRound(const SimConfig& cfg, SimShoe& shoe, SimRound& round, Strategy strategy) {
+    return playSimRound(shoe, round, strategy, cfg.rules);
+}
+
+struct SpecializedRules {
+    RuntimeRules rules;
+    SimTrialFn play;
+    SimRoundFn playRound;
+};
+
+template <typename Policy>
+SpecializedRules specialize() {
+    return {runtimeRulesOf(Policy()), &playPolicyTrial<Policy>, &playPolicyRound<Policy>};
+}
+
+// Common tables, pre-instantiated with every rule folded into the round loop
+const SpecializedRules SPECIALIZED_RULES[] = {
+    specialize<TableRules>(),
+    specialize<RulePolicy<true, 3, 2, 20, 7>>(),
+    specialize<RulePolicy<false, 6, 5, 20, 7>>(),
+    specialize<RulePolicy<true, 6, 5, 20, 7>>(),
+};
+
+// Finds the pre-instantiated entry for a rule set; nullptr for the generic path
+const SpecializedRules* specializedRules(const RuntimeRules& rules) {
+    for (const SpecializedRules& entry : SPECIALIZED_RULES) {
+        if (sameRules(entry.rules, rules)) return &entry;
+    }
+    return nullptr;
+}
+
+SimTrialFn simTrialFor(const RuntimeRules& rules) {
+    const SpecializedRules* entry = specializedRules(rules);
+    return entry != nullptr ? entry->play : &playRuntimeTrial;
+}
+
+SimRoundFn simRoundFor(const RuntimeRules& rules) {
+    const SpecializedRules* entry = specializedRules(rules);
+    return entry != nullptr ? entry->playRound : &playRuntimeRound;
+}
+
+void printRules(const RuntimeRules& rules) {
+    std::cout << "Rules: " << describeRules(rules)
+              << (specializedRules(rules) != nullptr ? " (specialized)" : " (generic)") << std::endl;
+}
+
+int workerCount(int requested) {
+    if (requested > 0) return requested;
+    unsigned hw = std::thread::hardware_concurrency();
+    return hw > 0 ? static_cast<int>(hw) : 1;
+}
+
+// Splits [0, count) into contiguous ranges, one per worker thread
+template <typename Work>
+void parallelFor(long long count, int threads, Work work) {
+    std::vector<std::thread> pool;
+    long long chunk = (count + threads - 1) / threads;
+    for (int t = 0; t < threads; ++t) {
+        long long begin = t * chunk;
+        long long end = std::min(count, begin + chunk);
+        if (begin >= end) break;
+        pool.emplace_back(work, t, begin, end);
+    }
+    for (auto& worker : pool) worker.join();
+}
+
+// Worker threads kept for a run of many parallel steps, so each step costs a
+// wakeup rather than creating and joining threads. forEach splits [0, count)
+// into the same ranges parallelFor would and returns once all are done.
+class WorkerPool {
+public:
+    explicit WorkerPool(int threads) {
+        for (int t = 0; t < threads; ++t) workers.emplace_back([this, t] { serve(t); });
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        started.notify_all();
+        for (std::thread& worker : workers) worker.join();
+    }
+
+    template <typename Work>
+    void forEach(long long count, Work work) {
+        std::unique_lock<std::mutex> lock(mutex);
+        job = [](void* context, int t, long long begin, long long end) { (*static_cast<Work*>(context))(t, begin, end); };
+        jobContext = &work;
+        jobCount = count;
+        chunk = (count + static_cast<long long>(workers.size()) - 1) / static_cast<long long>(workers.size());
+        pending = static_cast<int>(workers.size());
+        ++generation;
+        started.notify_all();
+        finished.wait(lock, [this] { return pending == 0; });
+    }
+
+private:
+    void serve(int t) {
+        unsigned long long done = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            started.wait(lock, [&] { return stopping || generation != done; });
+            if (stopping) return;
+            done = generation;
+            long long begin = t * chunk;
+            long long end = std::min(jobCount, begin + chunk);
+            lock.unlock();
+            if (begin < end) job(jobContext, t, begin, end);
+            lock.lock();
+            if (--pending == 0) finished.notify_one();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable started;
+    std::condition_variable finished;
+    void (*job)(void*, int, long long, long long) = nullptr;
+    void* jobContext = nullptr;
+    long long jobCount = 0;
+    long long chunk = 0;
+    int pending = 0;
+    unsigned long long generation = 0;
+    bool stopping = false;
+};
+
+void printEstimate(const std::string& label, const RunningStats& stats) {
+    double half = 1.96 * stats.stdError();
+    std::cout << label << stats.mean() << " (95% CI " << stats.mean() - half
+              << " .. " << stats.mean() + half << ")" << std::endl;
+}
+
+// Compares a simulated side bet with its exact value. Any shuffled position
+// deals like a fresh shoe, so the two must agree; a gap means the simulator
+// is dealing cards wrongly.
+bool printExactCheck(const RunningStats& stats, double exact) {
+    double z = (stats.mean() - exact) / std::max(stats.stdError(), 1e-12);
+    bool agrees = std::fabs(z) <= 4.0; // Generous, as for the solver's Monte Carlo check
+    std::cout << "  exact on a fresh shoe: " << exact << " (";
+    std::cout.precision(1);
+    std::cout << z << " standard errors, " << (agrees ? "agrees" : "DISAGREES") << ")" << std::endl;
+    std::cout.precision(5);
+    return agrees;
+}
+
+// Monte Carlo estimate of one strategy's expected value per hand
+int runSimulation(const SimConfig& cfg) {
+    int threads = workerCount(cfg.threads);
+    long long trials = (cfg.hands + cfg.roundsPerTrial - 1) / cfg.roundsPerTrial;
+    std::vector<RunningStats> partial(threads);
+    std::vector<SideBetTally> sideBets(threads);
+
+    RecordWriter writer;
+    bool recording = !cfg.recordsPath.empty();
+    if (recording && !writer.open(cfg.recordsPath, cfg.recordsCsv, threads)) {
+        std::cerr << "Cannot open " << cfg.recordsPath << " for writing." << std::endl;
+        return 1;
+    }
+
+    SimTrialFn playTrial = simTrialFor(cfg.rules);
+    parallelFor(trials, threads, [&](int t, long long begin, long long end) {
+        SimShoe shoe;
+        SimRound round;
+        RecordBuffer records(recording ? &writer : nullptr);
+        for (long long trial = begin; trial < end; ++trial) {
+            partial[t].add(playTrial(cfg, cfg.strategy, trial, false, shoe, round, recording ? &records : nullptr,
+                                     cfg.sideBets ? &sideBets[t] : nullptr) /
+                           cfg.roundsPerTrial);
+        }
+    });
+    writer.close();
+
+    RunningStats total;
+    for (const auto& p : partial) total.merge(p);
+
+    std::cout << std::fixed;
+    std::cout.precision(5);
+    std::cout << "--- SIMULATION ---" << std::endl;
+    std::cout << "Strategy: " << strategyName(cfg.strategy) << " | Decks: " << cfg.decks
+              << " | Hands: " << trials * cfg.roundsPerTrial << std::endl;
+    printRules(cfg.rules);
+    printEstimate("EV per hand: ", total);
+    bool sideBetsAgree = true;
+    if (cfg.sideBets) {
+        SideBetTally sideTotal;
+        for (const auto& tally : sideBets) sideTotal.merge(tally);
+        SideBetOdds exact = exactSideBetOdds(cfg.decks);
+        printEstimate("Perfect Pairs EV per unit: ", sideTotal.pairs);
+        sideBetsAgree = printExactCheck(sideTotal.pairs, exact.pairEv);
+        printEstimate("21+3 EV per unit: ", sideTotal.threeCard);
+        sideBetsAgree = printExactCheck(sideTotal.threeCard, exact.threeCardEv) && sideBetsAgree;
+    }
+    if (recording) {
+        std::cout << "Records: " << writer.rowsWritten() << " hands written to " << cfg.recordsPath
+                  << (cfg.recordsCsv ? " (CSV)" : " (columnar)") << std::endl;
+    }
+    return sideBetsAgree ? 0 : 1;
+}
+
+// Compares two strategies on common random numbers: both play the very same
+// shoe sequence in every trial, so most of the shoe noise cancels in the
+// paired difference. With antithetic pairing each sample also averages the
+// trial with its mirrored shoe (see startSimTrial), and the correlation
+// within those pairs is reported: averaging only pays when it is negative.
+int runComparison(const SimConfig& cfg) {
+    int threads = workerCount(cfg.threads);
+    int trialsPerSample = cfg.antithetic ? 2 : 1;
+    long long handsPerSample = static_cast<long long>(cfg.roundsPerTrial) * trialsPerSample;
+    long long samples = (cfg.hands + handsPerSample - 1) / handsPerSample;
+
+    struct Partial {
+        RunningStats a, b, diff;     // Per sample
+        RunningStats singleA, singleB; // Per trial, as independent runs would see them
+        RunningStats pairDiff[2];    // Difference in each half of an antithetic pair
+    };
+    std::vector<Partial> partial(threads);
+
+    SimTrialFn playTrial = simTrialFor(cfg.rules);
+    parallelFor(samples, threads, [&](int t, long long begin, long long end) {
+        Partial& p = partial[t];
+        SimShoe shoe;
+        SimRound round;
+        for (long long sample = begin; sample < end; ++sample) {
+            double sumA = 0.0, sumB = 0.0;
+            for (int k = 0; k < trialsPerSample; ++k) {
+                bool mirror = (k == 1);
+                double a = playTrial(cfg, cfg.strategy, sample, mirror, shoe, round, nullptr, nullptr) /
+                           cfg.roundsPerTrial;
+                double b = playTrial(cfg, cfg.otherStrategy, sample, mirror, shoe, round, nullptr, nullptr) /
+                           cfg.roundsPerTrial;
+                p.singleA.add(a);
+                p.singleB.add(b);
+                p.pairDiff[k].add(a - b);
+                sumA += a;
+                sumB += b;
+            }
+            p.a.add(sumA / trialsPerSample);
+            p.b.add(sumB / trialsPerSample);
+            p.diff.add((sumA - sumB) / trialsPerSample);
+        }
+    });
+
+    Partial total;
+    for (const auto& p : partial) {
+        total.a.merge(p.a);
+        total.b.merge(p.b);
+        total.diff.merge(p.diff);
+        total.singleA.merge(p.singleA);
+        total.singleB.merge(p.singleB);
+        total.pairDiff[0].merge(p.pairDiff[0]);
+        total.pairDiff[1].merge(p.pairDiff[1]);
+    }
+
+    // Variance of the difference had the two strategies been run independently
+    double independentVar = total.singleA.variance() / total.singleA.n + total.singleB.variance() / total.singleB.n;
+    double pairedVar = total.diff.variance() / total.diff.n;
+    double reduction = pairedVar > 0.0 ? independentVar / pairedVar : 0.0;
+
+    std::string nameA = strategyName(cfg.strategy);
+    std::string nameB = strategyName(cfg.otherStrategy);
+    std::cout << std::fixed;
+    std::cout.precision(5);
+    std::cout << "--- STRATEGY COMPARISON ---" << std::endl;
+    std::cout << "Common random numbers: " << samples << " samples x " << handsPerSample
+              << " hands per strategy" << (cfg.antithetic ? " (antithetic pairs)" : "")
+              << " | Decks: " << cfg.decks << std::endl;
+    printRules(cfg.rules);
+    printEstimate(nameA + " EV per hand: ", total.a);
+    printEstimate(nameB + " EV per hand: ", total.b);
+    printEstimate("Difference (" + nameA + " - " + nameB + "): ", total.diff);
+    std::cout.precision(2);
+    std::cout << "Variance reduction vs independent runs: " << reduction << "x (about "
+              << static_cast<long long>(reduction * samples * handsPerSample)
+              << " independent hands per strategy for the same precision)" << std::endl;
+    if (cfg.antithetic) {
+        // The sample mean is (d0 + d1) / 2, so 4 Var(mean) = Var d0 + Var d1 + 2 Cov(d0, d1)
+        double var0 = total.pairDiff[0].variance(), var1 = total.pairDiff[1].variance();
+        double covariance = (4.0 * total.diff.variance() - var0 - var1) / 2.0;
+        double correlation = var0 > 0.0 && var1 > 0.0 ? covariance / std::sqrt(var0 * var1) : 0.0;
+        std::cout.precision(3);
+        std::cout << "Correlation within antithetic pairs: " << correlation
+                  << (correlation < 0.0 ? " (pairing helps)" : " (pairing does not help)") << std::endl;
+    }
+    return 0;
+}
+
+// Verifies that steady-state simulated rounds never call operator new.
+// Each configuration warms up first so one-time shoe storage is excluded.
+int runAllocationCheck() {
+    const int warmupRounds = 1000;
+    const int checkedRounds = 100000;
+    const Strategy strategies[] = {STRATEGY_BASIC, STRATEGY_DEALER, STRATEGY_NEVER_BUST};
+    const int deckCounts[] = {1, 8};
+    bool ok = true;
+
+    for (int decks : deckCounts) {
+        for (Strategy strategy : strategies) {
+            SimConfig cfg;
+            cfg.decks = decks;
+            SimShoe shoe;
+            SimRound round;
+            startSimTrial(shoe, cfg, 0, false);
+            for (int r = 0; r < warmupRounds; ++r) playSimRound(shoe, round, strategy);
+
+            unsigned long long before = threadAllocations;
+            for (int r = 0; r < checkedRounds; ++r) {
+                if (r % 100 == 0) startSimTrial(shoe, cfg, r, (r / 100) % 2 == 1);
+                playSimRound(shoe, round, strategy);
+            }
+            unsigned long long allocations = threadAllocations - before;
+
+            std::cout << strategyName(strategy) << ", " << decks << " deck(s): " << allocations
+                      << " allocations in " << checkedRounds << " rounds" << std::endl;
+            if (allocations != 0) ok = false;
+        }
+    }
+    std::cout << (ok ? "PASS" : "FAIL") << ": steady-state rounds " << (ok ? "do not" : "do")
+              << " allocate" << std::endl;
+    return ok ? 0 : 1;
+}
+
+// --- Bankroll Analysis ---
+// Plays many independent sessions from a starting bankroll. A session ends
+// when the balance can no longer cover the table minimum (ruin), when a stop
+// is reached, or at the round cap. Each session seeds its own shoe from its
+// index, so results do not depend on the thread count.
+
+struct BankrollConfig {
+    long long sessions = 100000;
+    Money bankroll = Money::fromCents(10000);
+    Money bet = TABLE_MIN_BET; // Flat bet
+    double betFraction = 0.0;  // When positive, bet this fraction of the balance instead
+    Money stopWin;             // End once up this much; zero for none
+    Money stopLoss;            // End once down this much; zero for none
+    int maxRounds = 1000;
+};
+
+enum SessionEnd { SESSION_RUINED, SESSION_STOP_WIN, SESSION_STOP_LOSS, SESSION_ROUND_LIMIT };
+
+// Bet for the next round: the sizing rule in whole dollars, floored at the
+// table minimum and capped at the balance
+Money sessionBet(const BankrollConfig& bank, Money balance) {
+    Money bet = bank.bet;
+    if (bank.betFraction > 0.0) {
+        bet = Money::dollars(static_cast<long long>(std::floor(balance.inCents() * bank.betFraction / 100.0)));
+    }
+    return std::min(std::max(bet, TABLE_MIN_BET), balance);
+}
+
+// Value at quantile q of a sample; reorders the sample
+double percentile(std::vector<float>& sample, double q) {
+    if (sample.empty()) return 0.0;
+    size_t k = static_cast<size_t>(q * (sample.size() - 1) + 0.5);
+    std::nth_element(sample.begin(), sample.begin() + k, sample.end());
+    return sample[k];
+}
+
+void printPercentiles(const std::string& label, std::vector<float>& sample, const double* qs, int count) {
+    std::cout << label;
+    for (int k = 0; k < count; ++k) {
+        std::cout << (k > 0 ? " | p" : "p") << static_cast<int>(qs[k] * 100 + 0.5) << " " << percentile(sample, qs[k]);
+    }
+    std::cout << std::endl;
+}
+
+int runBankroll(const SimConfig& cfg, const BankrollConfig& bank) {
+    int threads = workerCount(cfg.threads);
+    SimRoundFn playRound = simRoundFor(cfg.rules);
+    const long long den = cfg.rules.blackjackDen;
+    std::vector<float> finals(bank.sessions);
+    std::vector<float> lengths(bank.sessions);
+    std::vector<unsigned char> endings(bank.sessions);
+    auto started = std::chrono::steady_clock::now();
+
+    parallelFor(bank.sessions, threads, [&](int, long long begin, long long end) {
+        SimShoe shoe;
+        SimRound round;
+        for (long long session = begin; session < end; ++session) {
+            startSimTrial(shoe, cfg, session, false);
+            Money balance = bank.bankroll;
+            SessionEnd ending = SESSION_ROUND_LIMIT;
+            int rounds = 0;
+            while (rounds < bank.maxRounds) {
+                if (balance < TABLE_MIN_BET) {
+                    ending = SESSION_RUINED;
+                    break;
+                }
+                if (bank.stopWin > Money() && balance >= bank.bankroll + bank.stopWin) {
+                    ending = SESSION_STOP_WIN;
+                    break;
+                }
+                if (bank.stopLoss > Money() && balance <= bank.bankroll - bank.stopLoss) {
+                    ending = SESSION_STOP_LOSS;
+                    break;
+                }
+                // A round pays a whole number of 1/blackjackDen bets, so it
+                // settles like the table does, dropping any fraction of a cent
+                double payout = playRound(cfg, shoe, round, cfg.strategy);
+                balance += sessionBet(bank, balance).scaled(std::llround(payout * den), den);
+                rounds++;
+            }
+            if (ending == SESSION_ROUND_LIMIT && balance < TABLE_MIN_BET) ending = SESSION_RUINED;
+            finals[session] = static_cast<float>(balance.inCents() / 100.0);
+            lengths[session] = static_cast<float>(rounds);
+            endings[session] = static_cast<unsigned char>(ending);
+        }
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    long long endCounts[4] = {};
+    long long totalRounds = 0;
+    RunningStats finalStats;
+    std::vector<float> ruinLengths;
+    for (long long s = 0; s < bank.sessions; ++s) {
+        endCounts[endings[s]]++;
+        totalRounds += static_cast<long long>(lengths[s]);
+        finalStats.add(finals[s]);
+        if (endings[s] == SESSION_RUINED) ruinLengths.push_back(lengths[s]);
+    }
+    double n = static_cast<double>(bank.sessions);
+    double ruin = endCounts[SESSION_RUINED] / n;
+    double ruinHalf = 1.96 * std::sqrt(ruin * (1.0 - ruin) / n);
+
+    std::cout << std::fixed;
+    std::cout.precision(2);
+    std::cout << "--- BANKROLL ---" << std::endl;
+    std::cout << "Sessions: " << bank.sessions << " | Bankroll: " << bank.bankroll << " | Bet: ";
+    if (bank.betFraction > 0.0) {
+        std::cout << bank.betFraction * 100.0 << "% of balance";
+    } else {
+        std::cout << bank.bet << " flat";
+    }
+    std::cout << " | Stop win: " << (bank.stopWin > Money() ? bank.stopWin.toString() : "none")
+              << " | Stop loss: " << (bank.stopLoss > Money() ? bank.stopLoss.toString() : "none")
+              << " | Max rounds: " << bank.maxRounds << std::endl;
+    std::cout << "Strategy: " << strategyName(cfg.strategy) << " | Decks: " << cfg.decks << std::endl;
+    printRules(cfg.rules);
+    std::cout << "Risk of ruin: " << 100.0 * ruin << "% (95% CI " << 100.0 * std::max(0.0, ruin - ruinHalf) << "% .. "
+              << 100.0 * std::min(1.0, ruin + ruinHalf) << "%)" << std::endl;
+    std::cout << "Stop win: " << 100.0 * endCounts[SESSION_STOP_WIN] / n
+              << "% | Stop loss: " << 100.0 * endCounts[SESSION_STOP_LOSS] / n
+              << "% | Round limit: " << 100.0 * endCounts[SESSION_ROUND_LIMIT] / n << "%" << std::endl;
+
+    const double lengthQs[] = {0.10, 0.25, 0.50, 0.75, 0.90};
+    const double finalQs[] = {0.01, 0.05, 0.25, 0.50, 0.75, 0.95, 0.99};
+    std::cout.precision(0);
+    if (!ruinLengths.empty()) {
+        printPercentiles("Rounds until ruin: ", ruinLengths, lengthQs, 5);
+    }
+    std::cout.precision(2);
+    printPercentiles("Final balance: ", finals, finalQs, 7);
+    std::cout << "Mean final balance: " << finalStats.mean() << " (" << totalRounds << " rounds in " << seconds
+              << " s on " << threads << " thread(s))" << std::endl;
+    return 0;
+}
+
+// --- Tournament ---
+// Elimination tournament between bots. Each level shards the remaining
+// players over tables of up to seatsPerTable, plays every table for a fixed
+// number of rounds on one pool of worker threads kept for the whole
+// tournament, and advances each table's top balances. Qualifiers carry their
+// balances into the next level. Every table writes its qualifiers into its
+// own slots, so the merge between levels is a concatenation; the next level
+// reseats that list with the level's seed. A table's shoe is seeded from
+// (seed, level, table), so the bracket does not depend on the thread count.
+
+struct TournamentConfig {
+    int players = 343;
+    int seatsPerTable = 7;
+    long long rounds = 30;    // Rounds per table per level
+    int advance = 2;          // Qualifiers per table
+    long long bet = 5;        // Flat bet in dollars; a seat that cannot cover it quits
+    long long bankroll = 100; // Starting balance; qualifiers keep theirs from level to level
+    int decks = 6;
+    unsigned long long seed = 1;
+    int threads = 0;
+};
+
+// Bots cycle through the strategies, so each level shows which one advances
+const Strategy TOURNAMENT_STRATEGIES[] = {STRATEGY_BASIC, STRATEGY_DEALER, STRATEGY_NEVER_BUST};
+const int TOURNAMENT_STRATEGY_COUNT = 3;
+
+struct Standing {
+    int player;
+    Money balance;
+};
+
+// Higher balance first; the lower player number breaks ties
+bool standingBefore(const Standing& a, const Standing& b) {
+    return a.balance != b.balance ? a.balance > b.balance : a.player < b.player;
+}
+
+unsigned long long tableSeed(unsigned long long seed, int level, long long table) {
+    return seed * 0x9E3779B97F4A7C15ULL ^ (static_cast<unsigned long long>(level) << 40) ^
+           static_cast<unsigned long long>(table) * 0xD1B54A32D192ED03ULL;
+}
+
+// Plays one table for the configured rounds from the entrants' balances and
+// returns its seats ranked
+std::vector<Standing> playTournamentTable(const TournamentConfig& cfg, const Standing* entrants, int count,
+                                          unsigned long long seed) {
+    SeatTable table;
+    for (int k = 0; k < count; ++k) table.addSeat("Player " + std::to_string(entrants[k].player + 1), entrants[k].balance);
+    const Money bet = Money::dollars(cfg.bet);
+
+    Xoshiro256 rng;
+    rng.seed(seed);
+    std::vector<Card> deck;
+    auto reshuffle = [&] {
+        createShoe(deck, cfg.decks);
+        fastShuffle(deck.data(), deck.size(), rng);
+    };
+    // A hand that runs the shoe dry draws from a fresh one, seeded like the rest
+    auto draw = [&] {
+        if (deck.empty()) reshuffle();
+        Card card = deck.back();
+        deck.pop_back();
+        return card;
+    };
+    reshuffle();
+    const size_t cutCard = std::max(deck.size() / 4, 2 * static_cast<size_t>(count + 1));
+
+    Hand dealerHand;
+    for (long long round = 0; round < cfg.rounds; ++round) {
+        int active = 0;
+        for (int seat : table.seats(ACTIVE_SEATS)) {
+            if (table.money[seat] < bet) {
+                table.setStatus(seat, QUIT);
+                continue;
+            }
+            table.hands[seat].clear();
+            table.bets[seat] = bet;
+            table.setStatus(seat, PLAYING);
+            active++;
+        }
+        if (active == 0) break;
+        if (deck.size() < cutCard) reshuffle();
+
+        dealerHand.clear();
+        dealInitialCards(deck, table, ACTIVE_SEATS, active, dealerHand, nullptr, false);
+        bool dealerHasBJ = calculateHandTotal(dealerHand) == 21;
+        int upcard = dealerHand[1].value;
+        for (int seat : table.seats(statusBit(PLAYING))) {
+            table.setStatus(seat, initialStatus(calculateHandTotal(table.hands[seat]), dealerHasBJ));
+        }
+        for (int seat : table.seats(statusBit(PLAYING))) {
+            Hand& hand = table.hands[seat];
+            Strategy strategy = TOURNAMENT_STRATEGIES[entrants[seat].player % TOURNAMENT_STRATEGY_COUNT];
+            while (table.statusOf(seat) == PLAYING) {
+                if (shouldHit(strategy, calculateHandTotal(hand), isSoftHand(hand), upcard)) {
+                    hand.push_back(draw());
+                    if (calculateHandTotal(hand) > 21) table.setStatus(seat, BUSTED);
+                } else {
+                    table.setStatus(seat, STANDING);
+                }
+            }
+        }
+
+        bool dealerBusted = false;
+        if (table.any(STANDING)) {
+            while (dealerShouldHit(dealerHand)) dealerHand.push_back(draw());
+            dealerBusted = calculateHandTotal(dealerHand) > 21;
+        }
+        int dealerTotal = calculateHandTotal(dealerHand);
+        for (int seat : table.seats(ACTIVE_SEATS)) {
+            table.money[seat] += settleBet(table.statusOf(seat), table.bets[seat], calculateHandTotal(table.hands[seat]),
+                                           dealerTotal, dealerBusted);
+        }
+    }
+
+    std::vector<Standing> ranked(count);
+    for (int seat = 0; seat < count; ++seat) ranked[seat] = {entrants[seat].player, table.money[seat]};
+    std::sort(ranked.begin(), ranked.end(), standingBefore);
+    return ranked;
+}
+
+void printStrategyShare(const std::vector<Standing>& players) {
+    long long counts[TOURNAMENT_STRATEGY_COUNT] = {};
+    for (const Standing& standing : players) counts[standing.player % TOURNAMENT_STRATEGY_COUNT]++;
+    for (int s = 0; s < TOURNAMENT_STRATEGY_COUNT; ++s) {
+        std::cout << (s > 0 ? ", " : "") << strategyName(TOURNAMENT_STRATEGIES[s]) << " "
+                  << 100.0 * counts[s] / std::max<size_t>(players.size(), 1) << "%";
+    }
+}
+
+int runTournament(const TournamentConfig& cfg) {
+    int threads = workerCount(cfg.threads);
+    std::vector<Standing> players(cfg.players);
+    for (int p = 0; p < cfg.players; ++p) players[p] = {p, Money::dollars(cfg.bankroll)};
+
+    std::cout << std::fixed;
+    std::cout.precision(1);
+    std::cout << "--- TOURNAMENT ---" << std::endl;
+    std::cout << cfg.players << " players, " << cfg.seatsPerTable << " seats per table, " << cfg.rounds
+              << " rounds per level, top " << cfg.advance << " per table advance with their balances | Bet $"
+              << cfg.bet << ", $" << cfg.bankroll << " to start | Seed " << cfg.seed << std::endl;
+
+    WorkerPool pool(threads);
+    auto started = std::chrono::steady_clock::now();
+    for (int level = 1;; ++level) {
+        // Reseat, so qualifiers from one table spread over the next level
+        Xoshiro256 seating;
+        seating.seed(tableSeed(cfg.seed, level, -1));
+        for (size_t k = players.size(); k > 1; --k) std::swap(players[k - 1], players[boundedRandom(seating, k)]);
+
+        const long long count = static_cast<long long>(players.size());
+        const bool finalTable = count <= cfg.seatsPerTable;
+        const long long tables = finalTable ? 1 : (count + cfg.seatsPerTable - 1) / cfg.seatsPerTable;
+        const int advance = finalTable ? 1 : cfg.advance;
+
+        // Table t seats players [t * count / tables, (t + 1) * count / tables)
+        std::vector<Standing> qualifiers(tables * advance, Standing{-1, Money()});
+        std::vector<Standing> finalStandings;
+        auto levelStarted = std::chrono::steady_clock::now();
+        pool.forEach(tables, [&](int, long long begin, long long end) {
+            for (long long t = begin; t < end; ++t) {
+                long long first = t * count / tables;
+                long long last = (t + 1) * count / tables;
+                std::vector<Standing> ranked = playTournamentTable(cfg, players.data() + first,
+                                                                   static_cast<int>(last - first), tableSeed(cfg.seed, level, t));
+                for (int k = 0; k < advance && k < static_cast<int>(ranked.size()); ++k) qualifiers[t * advance + k] = ranked[k];
+                if (finalTable) finalStandings = ranked;
+            }
+        });
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - levelStarted).count();
+
+        if (finalTable) {
+            std::cout << "Final table (" << count << " players, " << seconds * 1000.0 << " ms):" << std::endl;
+            for (size_t k = 0; k < finalStandings.size(); ++k) {
+                int player = finalStandings[k].player;
+                std::cout << "  " << k + 1 << ". Player " << player + 1 << " ("
+                          << strategyName(TOURNAMENT_STRATEGIES[player % TOURNAMENT_STRATEGY_COUNT]) << ") $"
+                          << finalStandings[k].balance << std::endl;
+            }
+            break;
+        }
+
+        players.clear();
+        for (const Standing& standing : qualifiers) {
+            if (standing.player >= 0) players.push_back(standing);
+        }
+        std::cout << "Level " << level << ": " << tables << " tables, " << count << " -> " << players.size()
+                  << " players (" << seconds * 1000.0 << " ms) | Advancing: ";
+        printStrategyShare(players);
+        std::cout << std::endl;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::cout.precision(2);
+    std::cout << "Time: " << seconds << " s on " << threads << " thread(s)" << std::endl;
+    return 0;
+}
+
+// --- Exact Solver ---
+// Computes the exact EV of a fixed strategy for one hand dealt from a fresh
+// small shoe by walking every card order. Orders that reach the same shoe
+// composition share work: the dealer's final-total distribution is memoized on
+// (composition, dealer hand). The first four cards split the work across threads.
+
+// Card classes: 0 = Ace, 1..8 = 2..9, 9 = ten-valued
+const int CARD_CLASSES = 10;
+const char* const CLASS_NAMES[] = {"A", "2", "3", "4", "5", "6", "7", "8", "9", "T"};
+
+int classHardValue(int cls) {
+    return cls == 0 ? 1 : cls + 1;
+}
+
+struct ShoeComposition {
+    int counts[CARD_CLASSES] = {};
+    int total = 0;
+
+    void remove(int cls) {
+        counts[cls]--;
+        total--;
+    }
+    void restore(int cls) {
+        counts[cls]++;
+        total++;
+    }
+    // 5 bits per class and 6 for tens; see solverShoeFits
+    unsigned long long key() const {
+        unsigned long long k = 0;
+        for (int c = 0; c < CARD_CLASSES - 1; ++c) k = (k << 5) | counts[c];
+        return (k << 6) | counts[CARD_CLASSES - 1];
+    }
+};
+
+bool solverShoeFits(const ShoeComposition& comp) {
+    for (int c = 0; c < CARD_CLASSES - 1; ++c) {
+        if (comp.counts[c] > 31) return false;
+    }
+    return comp.counts[CARD_CLASSES - 1] <= 63 && comp.total >= 4;
+}
+
+// Reference hand total, kept independent of calculateHandTotal:
+// hard counts every Ace as 1, and one Ace is promoted to 11 when it fits
+int referenceTotal(int hard, bool hasAce) {
+    return (hasAce && hard + 10 <= 21) ? hard + 10 : hard;
+}
+
+bool referenceSoft(int hard, bool hasAce) {
+    return hasAce && hard + 10 <= 21;
+}
+
+// Probability of each dealer finish: 17..21, bust, or shoe exhausted
+struct DealerFinish {
+    double p[7] = {};
+};
+
+class ExactSolver {
+public:
+    explicit ExactSolver(Strategy strategy) : strategy(strategy) {}
+
+    double ev = 0.0, win = 0.0, push = 0.0, loss = 0.0, blackjack = 0.0, voided = 0.0;
+
+    // Resolves one initial deal (player, hole, player, upcard) of the given probability
+    void playDeal(ShoeComposition& comp, int p1, int hole, int p2, int up, double weight) {
+        int playerHard = classHardValue(p1) + classHardValue(p2);
+        bool playerAce = (p1 == 0 || p2 == 0);
+        int dealerHard = classHardValue(hole) + classHardValue(up);
+        bool dealerAce = (hole == 0 || up == 0);
+        bool dealerHasBJ = referenceTotal(dealerHard, dealerAce) == 21;
+
+        switch (initialStatus(referenceTotal(playerHard, playerAce), dealerHasBJ)) {
+            case BLACKJACK:
+                blackjack += weight;
+                win += weight;
+                ev += 1.5 * weight;
+                break;
+            case STANDING: // Both Blackjack
+                push += weight;
+                break;
+            case BUSTED: // Dealer Blackjack
+                loss += weight;
+                ev -= weight;
+                break;
+            default:
+                playHand(comp, playerHard, playerAce, dealerHard, dealerAce, up == 0 ? 11 : classHardValue(up), weight);
+                break;
+        }
+    }
+
+    size_t memoSize() const { return dealerMemo.size(); }
+
+private:
+    void playHand(ShoeComposition& comp, int hard, bool hasAce, int dealerHard, bool dealerAce, int upcard,
+                  double weight) {
+        int total = referenceTotal(hard, hasAce);
+        if (total > 21) {
+            loss += weight;
+            ev -= weight;
+            return;
+        }
+        if (shouldHit(strategy, total, referenceSoft(hard, hasAce), upcard)) {
+            if (comp.total == 0) {
+                voided += weight;
+                return;
+            }
+            double cards = comp.total;
+            for (int c = 0; c < CARD_CLASSES; ++c) {
+                if (comp.counts[c] == 0) continue;
+                double p = comp.counts[c] / cards;
+                comp.remove(c);
+                playHand(comp, hard + classHardValue(c), hasAce || c == 0, dealerHard, dealerAce, upcard, weight * p);
+                comp.restore(c);
+            }
+            return;
+        }
+
+        DealerFinish finish = dealerFinish(comp, dealerHard, dealerAce);
+        for (int k = 0; k < 5; ++k) {
+            int dealerTotal = 17 + k;
+            double w = weight * finish.p[k];
+            if (total > dealerTotal) {
+                win += w;
+                ev += w;
+            } else if (total < dealerTotal) {
+                loss += w;
+                ev -= w;
+            } else {
+                push += w;
+            }
+        }
+        win += weight * finish.p[5];
+        ev += weight * finish.p[5];
+        voided += weight * finish.p[6];
+    }
+
+    // Returned by value: recursion may rehash the memo and move its entries
+    DealerFinish dealerFinish(ShoeComposition& comp, int hard, bool hasAce) {
+        DealerFinish finish;
+        int total = referenceTotal(hard, hasAce);
+        if (total >= 17) {
+            finish.p[total > 21 ? 5 : total - 17] = 1.0;
+            return finish;
+        }
+        if (comp.total == 0) {
+            finish.p[6] = 1.0;
+            return finish;
+        }
+
+        unsigned long long key = (comp.key() << 6) | (static_cast<unsigned long long>(hard) << 1) | (hasAce ? 1 : 0);
+        auto found = dealerMemo.find(key);
+        if (found != dealerMemo.end()) return found->second;
+
+        double cards = comp.total;
+        for (int c = 0; c < CARD_CLASSES; ++c) {
+            if (comp.counts[c] == 0) continue;
+            double p = comp.counts[c] / cards;
+            comp.remove(c);
+            DealerFinish next = dealerFinish(comp, hard + classHardValue(c), hasAce || c == 0);
+            comp.restore(c);
+            for (int k = 0; k < 7; ++k) finish.p[k] += p * next.p[k];
+        }
+        dealerMemo.emplace(key, finish);
+        return finish;
+    }
+
+    Strategy strategy;
+    std::unordered_map<unsigned long long, DealerFinish> dealerMemo;
+};
+
+// Checks calculateHandTotal and isSoftHand against the reference rule for
+// every multiset of up to maxCards cards; returns the number of mismatches
+long long verifyHandTotals(int maxCards, long long& checked) {
+    long long mismatches = 0;
+    checked = 0;
+    int counts[CARD_CLASSES] = {};
+    // Walks multisets in non-decreasing class order
+    std::vector<int> stack;
+    auto visit = [&](auto&& self, int firstClass) -> void {
+        if (!stack.empty()) {
+            Hand hand;
+            int hard = 0;
+            bool hasAce = false;
+            for (int cls : stack) {
+                Card card;
+                card.suit = 0;
+                card.rank = static_cast<unsigned char>(cls == 9 ? 9 : cls); // 9 is the "10" rank
+                card.value = static_cast<unsigned char>(cls == 0 ? 11 : cls + 1);
+                hand.push_back(card);
+                hard += classHardValue(cls);
+                hasAce = hasAce || cls == 0;
+            }
+            checked++;
+            if (calculateHandTotal(hand) != referenceTotal(hard, hasAce) ||
+                isSoftHand(hand) != referenceSoft(hard, hasAce)) {
+                mismatches++;
+            }
+        }
+        if (static_cast<int>(stack.size()) == maxCards) return;
+        for (int c = firstClass; c < CARD_CLASSES; ++c) {
+            counts[c]++;
+            stack.push_back(c);
+            self(self, c);
+            stack.pop_back();
+            counts[c]--;
+        }
+    };
+    visit(visit, 0);
+    return mismatches;
+}
+
+struct SolveConfig {
+    ShoeComposition shoe;
+    Strategy strategy = STRATEGY_BASIC;
+    int threads = 0;
+    long long monteCarloRounds = 0;
+    unsigned seed = 1;
+};
+
+// The solver's table rules, except that only an exhausted shoe is reshuffled
+typedef RulePolicy<false, 3, 2, 1, 1> SolverRules;
+
+// Monte Carlo estimate on the same fresh shoe, dealt by the simulator itself
+RunningStats monteCarloOnShoe(const SolveConfig& cfg, int threads) {
+    std::vector<Card> cards;
+    for (int c = 0; c < CARD_CLASSES; ++c) {
+        for (int k = 0; k < cfg.shoe.counts[c]; ++k) {
+            cards.push_back({0, static_cast<unsigned char>(c), static_cast<unsigned char>(c == 0 ? 11 : c + 1)});
+        }
+    }
+    std::vector<RunningStats> partial(threads);
+    parallelFor(cfg.monteCarloRounds, threads, [&](int t, long long begin, long long end) {
+        SimShoe shoe;
+        SimRound round;
+        shoe.cards = cards;
+        shoe.rng.seed((static_cast<unsigned long long>(cfg.seed) << 32) ^ static_cast<unsigned long long>(begin));
+        for (long long r = begin; r < end; ++r) {
+            reshuffleSimShoe(shoe);
+            partial[t].add(playSimRound(shoe, round, cfg.strategy, SolverRules()));
+        }
+    });
+    RunningStats total;
+    for (const auto& p : partial) total.merge(p);
+    return total;
+}
+
+int runSolver(const SolveConfig& cfg) {
+    if (!solverShoeFits(cfg.shoe)) {
+        std::cerr << "The solver needs at least 4 cards, at most 31 of each rank and 63 ten-valued cards." << std::endl;
+        return 1;
+    }
+    int threads = workerCount(cfg.threads);
+    auto began = std::chrono::steady_clock::now();
+
+    // Every ordered initial deal is one task
+    struct Deal {
+        int p1, hole, p2, up;
+        double weight;
+    };
+    std::vector<Deal> deals;
+    ShoeComposition comp = cfg.shoe;
+    int drawn[4];
+    auto enumerate = [&](auto&& self, int depth, double weight) -> void {
+        if (depth == 4) {
+            deals.push_back({drawn[0], drawn[1], drawn[2], drawn[3], weight});
+            return;
+        }
+        double cards = comp.total;
+        for (int c = 0; c < CARD_CLASSES; ++c) {
+            if (comp.counts[c] == 0) continue;
+            double p = comp.counts[c] / cards;
+            drawn[depth] = c;
+            comp.remove(c);
+            self(self, depth + 1, weight * p);
+            comp.restore(c);
+        }
+    };
+    enumerate(enumerate, 0, 1.0);
+
+    std::atomic<size_t> nextDeal(0);
+    std::vector<ExactSolver> solvers(threads, ExactSolver(cfg.strategy));
+    parallelFor(threads, threads, [&](int t, long long, long long) {
+        ExactSolver& solver = solvers[t];
+        for (size_t i = nextDeal++; i < deals.size(); i = nextDeal++) {
+            const Deal& d = deals[i];
+            ShoeComposition local = cfg.shoe;
+            local.remove(d.p1);
+            local.remove(d.hole);
+            local.remove(d.p2);
+            local.remove(d.up);
+            solver.playDeal(local, d.p1, d.hole, d.p2, d.up, d.weight);
+        }
+    });
+
+    ExactSolver total(cfg.strategy);
+    size_t memoEntries = 0;
+    for (const ExactSolver& solver : solvers) {
+        total.ev += solver.ev;
+        total.win += solver.win;
+        total.push += solver.push;
+        total.loss += solver.loss;
+        total.blackjack += solver.blackjack;
+        total.voided += solver.voided;
+        memoEntries += solver.memoSize();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+
+    std::cout << std::fixed;
+    std::cout.precision(6);
+    std::cout << "--- EXACT SOLVER ---" << std::endl;
+    std::cout << "Shoe:";
+    for (int c = 0; c < CARD_CLASSES; ++c) std::cout << " " << CLASS_NAMES[c] << ":" << cfg.shoe.counts[c];
+    std::cout << " (" << cfg.shoe.total << " cards) | Strategy: " << strategyName(cfg.strategy) << std::endl;
+    std::cout << "Exact EV per hand: " << total.ev << std::endl;
+    std::cout << "P(win) " << total.win << " | P(push) " << total.push << " | P(loss) " << total.loss
+              << " | P(Blackjack) " << total.blackjack << " | P(shoe exhausted) " << total.voided << std::endl;
+    std::cout.precision(2);
+    std::cout << "Initial deals: " << deals.size() << " | Dealer states memoized: " << memoEntries
+              << " | Time: " << seconds << " s on " << threads << " thread(s)" << std::endl;
+
+    bool ok = true;
+    if (cfg.monteCarloRounds > 0) {
+        RunningStats mc = monteCarloOnShoe(cfg, threads);
+        double half = 1.96 * mc.stdError();
+        bool agrees = std::fabs(mc.mean() - total.ev) <= 2.0 * half; // Generous: about 4 standard errors
+        std::cout.precision(6);
+        std::cout << "Monte Carlo (" << mc.n << " rounds): " << mc.mean() << " (95% CI " << mc.mean() - half
+                  << " .. " << mc.mean() + half << ") " << (agrees ? "agrees" : "DISAGREES") << " with the exact EV"
+                  << std::endl;
+        if (total.voided > 0.0) {
+            std::cout << "Note: the simulator reshuffles an exhausted shoe where the solver voids the hand." << std::endl;
+        }
+        ok = ok && agrees;
+    }
+
+    long long checked = 0;
+    long long mismatches = verifyHandTotals(11, checked);
+    std::cout << "Hand totals: " << checked << " hands of up to 11 cards checked, " << mismatches << " mismatches"
+              << std::endl;
+    ok = ok && mismatches == 0;
+    return ok ? 0 : 1;
+}
+
+// --- Round Fuzzing ---
+// Random shoes and random decisions pushed through the headless round and
+// through the table's multi-seat phases, with invariants checked after each
+// round. Cards are drawn with replacement straight from the input, so shoes no
+// real deck could hold (six Aces in a row) come up as well. --fuzz runs it
+// in-process on generated inputs; a -DBJ_FUZZ build hands it to libFuzzer.
+
+// Decisions and cards come from the fuzz input; once it runs out, a generator
+// seeded from the input takes over, so short inputs still finish their rounds
+class FuzzInput {
+public:
+    FuzzInput(const unsigned char* data, size_t size) : data(data), size(size) {
+        unsigned long long hash = 0xCBF29CE484222325ULL; // FNV-1a
+        for (size_t i = 0; i < size; ++i) hash = (hash ^ data[i]) * 0x100000001B3ULL;
+        rng.seed(hash);
+    }
+
+    unsigned byte() { return pos < size ? data[pos++] : static_cast<unsigned>(rng() & 0xFF); }
+    bool flag() { return (byte() & 1) != 0; }
+    Card card() { return CANONICAL_DECK.cards[byte() % CARD_CODES]; } // Indexed by card code
+
+private:
+    const unsigned char* data;
+    size_t size;
+    size_t pos = 0;
+    Xoshiro256 rng;
+};
+
+// Returns the failed condition from the enclosing check function
+#define FUZZ_CHECK(cond) \
+    do {                 \
+        if (!(cond)) return #cond; \
+    } while (0)
+
+// Hands never exceed 31: a hit is allowed on 21 or less, and a card that busts a hand adds at most 10
+const char* checkHand(const Hand& hand) {
+    int hard = 0;
+    bool hasAce = false;
+    for (const Card& card : hand) {
+        hard += card.rank == ACE ? 1 : card.value;
+        hasAce = hasAce || card.rank == ACE;
+    }
+    FUZZ_CHECK(calculateHandTotal(hand) == referenceTotal(hard, hasAce));
+    FUZZ_CHECK(isSoftHand(hand) == referenceSoft(hard, hasAce));
+    FUZZ_CHECK(calculateHandTotal(hand) <= 31);
+    return nullptr;
+}
+
+// A dealer who played drew exactly while the rules say to, judged on reference totals
+const char* checkDealerPlay(const Hand& dealerHand, const RuntimeRules& rules) {
+    int hard = 0;
+    bool hasAce = false;
+    for (int k = 0; k < dealerHand.size(); ++k) {
+        hard += dealerHand[k].rank == ACE ? 1 : dealerHand[k].value;
+        hasAce = hasAce || dealerHand[k].rank == ACE;
+        if (k == 0) continue;
+        int total = referenceTotal(hard, hasAce);
+        bool hits = total < 17 || (rules.hitSoft17 && total == 17 && referenceSoft(hard, hasAce));
+        FUZZ_CHECK(hits == (k + 1 < dealerHand.size()));
+    }
+    return nullptr;
+}
+
+// The status a fresh two-card hand must take against the dealer's hand
+PlayerStatus expectedInitialStatus(int playerTotal, bool dealerHasBJ) {
+    if (dealerHasBJ) return playerTotal == 21 ? STANDING : BUSTED;
+    return playerTotal == 21 ? BLACKJACK : PLAYING;
+}
+
+// Expected payout in units of the bet, as an exact fraction over the payout denominator
+long long expectedPayout(PlayerStatus status, int playerTotal, int dealerTotal, bool dealerBusted,
+                         const RuntimeRules& rules) {
+    if (status == BLACKJACK) return rules.blackjackNum;
+    if (status == BUSTED) return -rules.blackjackDen;
+    if (dealerBusted || playerTotal > dealerTotal) return rules.blackjackDen;
+    return playerTotal < dealerTotal ? -rules.blackjackDen : 0;
+}
+
+// One headless round with random hit/stand decisions
+const char* fuzzSimRound(FuzzInput& input, const RuntimeRules& rules, SimShoe& shoe, SimRound& round) {
+    // Enough cards for both hands at full size, so the shoe never reshuffles
+    shoe.cards.resize(2 * MAX_HAND_CARDS);
+    for (Card& card : shoe.cards) card = input.card();
+    shoe.remaining = static_cast<int>(shoe.cards.size());
+    const Card firstCard = shoe.cards.back();
+
+    double payout = playSimRoundWith(shoe, round, [&](int, bool, int) { return input.flag(); }, rules);
+
+    const Hand& hand = round.hand;
+    const Hand& dealerHand = round.dealerHand;
+    FUZZ_CHECK(hand[0].suit == firstCard.suit && hand[0].rank == firstCard.rank); // Player is dealt first
+    if (const char* failure = checkHand(hand)) return failure;
+    if (const char* failure = checkHand(dealerHand)) return failure;
+
+    Hand initial;
+    initial.push_back(hand[0]);
+    initial.push_back(hand[1]);
+    int playerTotal = calculateHandTotal(hand);
+    int dealerTotal = calculateHandTotal(dealerHand);
+    PlayerStatus opening = expectedInitialStatus(calculateHandTotal(initial), round.dealerHasBJ);
+
+    int hits = 0;
+    for (char action : round.actions) hits += action == 'H';
+    FUZZ_CHECK(hits == hand.size() - 2);
+    FUZZ_CHECK(round.status == STANDING || round.status == BUSTED || round.status == BLACKJACK);
+    if (opening != PLAYING) {
+        FUZZ_CHECK(round.status == opening);
+        FUZZ_CHECK(round.actions.empty());
+    } else {
+        FUZZ_CHECK(!round.actions.empty());
+        FUZZ_CHECK(round.actions.back() == (round.status == BUSTED ? 'H' : 'S'));
+        FUZZ_CHECK((round.status == BUSTED) == (playerTotal > 21));
+    }
+    // The dealer only plays against a standing hand
+    if (round.status == STANDING) {
+        if (const char* failure = checkDealerPlay(dealerHand, rules)) return failure;
+    } else {
+        FUZZ_CHECK(dealerHand.size() == 2);
+    }
+    if (round.dealerHasBJ) FUZZ_CHECK(dealerHand.size() == 2);
+
+    long long expected = expectedPayout(round.status, playerTotal, dealerTotal, dealerTotal > 21, rules);
+    FUZZ_CHECK(std::llround(payout * rules.blackjackDen) == expected);
+    return nullptr;
+}
+
+// The table's phases for up to seven seats, each with a random balance, bets
+// and decisions, and money moving only between the seats and the house
+const char* fuzzTableRound(FuzzInput& input, const RuntimeRules& rules, SeatTable& table, std::vector<Card>& deck,
+                           Hand& dealerHand) {
+    int active = 1 + static_cast<int>(input.byte() % table.size());
+    int seated = 0;
+    Money total;
+    for (int seat = 0; seat < table.size(); ++seat) {
+        table.hands[seat].clear();
+        table.bets[seat] = table.pairBets[seat] = table.threeCardBets[seat] = Money();
+        // Separate statements fix the read order, so a saved input replays on any compiler
+        unsigned dollarsPart = input.byte();
+        unsigned centsPart = input.byte();
+        table.money[seat] = Money::dollars(dollarsPart) + Money::fromCents(centsPart % 100);
+        table.setStatus(seat, seat < active && table.money[seat] >= TABLE_MIN_BET ? PLAYING : QUIT);
+        total += table.money[seat];
+        if (table.statusOf(seat) == QUIT) continue;
+        seated++;
+        long long left = table.money[seat].wholeDollars();
+        table.bets[seat] = Money::dollars(1 + input.byte() % left);
+        left -= table.bets[seat].wholeDollars();
+        if (left > 0 && input.flag()) table.pairBets[seat] = Money::dollars(1 + input.byte() % left);
+        left -= table.pairBets[seat].wholeDollars();
+        if (left > 0 && input.flag()) table.threeCardBets[seat] = Money::dollars(1 + input.byte() % left);
+    }
+    if (seated == 0) return nullptr;
+    Money house;
+
+    // Every hand at full size fits, so the shoe is never refilled mid-round
+    deck.resize(static_cast<size_t>(table.size() + 1) * MAX_HAND_CARDS);
+    for (Card& card : deck) card = input.card();
+    const size_t dealtFrom = deck.size();
+    dealerHand.clear();
+    dealInitialCards(deck, table, ACTIVE_SEATS, seated, dealerHand, nullptr, false);
+    FUZZ_CHECK(deck.size() == dealtFrom - 2 * static_cast<size_t>(seated + 1));
+    FUZZ_CHECK(dealerHand.size() == 2);
+
+    bool dealerHasBJ = calculateHandTotal(dealerHand) == 21;
+    for (int seat : table.seats(statusBit(PLAYING))) {
+        const Hand& hand = table.hands[seat];
+        FUZZ_CHECK(hand.size() == 2);
+        Money delta = table.pairBets[seat] * PAIR_PAYS[pairResult(hand[0], hand[1])] +
+                      table.threeCardBets[seat] * THREE_CARD_PAYS[threeCardResult(hand[0], hand[1], dealerHand[1])];
+        table.money[seat] += delta;
+        house -= delta;
+        PlayerStatus status = initialStatus(calculateHandTotal(hand), dealerHasBJ);
+        FUZZ_CHECK(status == expectedInitialStatus(calculateHandTotal(hand), dealerHasBJ));
+        table.setStatus(seat, status);
+    }
+
+    if (!dealerHasBJ) {
+        for (int seat : table.seats(statusBit(PLAYING))) {
+            while (table.statusOf(seat) == PLAYING) {
+                if (input.flag()) {
+                    table.hands[seat].push_back(dealCard(deck, nullptr, false));
+                    if (calculateHandTotal(table.hands[seat]) > 21) table.setStatus(seat, BUSTED);
+                } else {
+                    table.setStatus(seat, STANDING);
+                }
+            }
+        }
+    }
+    FUZZ_CHECK(!table.any(PLAYING));
+
+    bool dealerMustPlay = table.any(STANDING);
+    bool dealerBusted = false;
+    if (dealerMustPlay) {
+        while (dealerShouldHit(dealerHand, rules)) dealerHand.push_back(dealCard(deck, nullptr, false));
+        dealerBusted = calculateHandTotal(dealerHand) > 21;
+        if (const char* failure = checkDealerPlay(dealerHand, rules)) return failure;
+    } else {
+        FUZZ_CHECK(dealerHand.size() == 2);
+    }
+    if (const char* failure = checkHand(dealerHand)) return failure;
+
+    int dealerTotal = calculateHandTotal(dealerHand);
+    for (int seat : table.seats(ACTIVE_SEATS)) {
+        if (const char* failure = checkHand(table.hands[seat])) return failure;
+        int playerTotal = calculateHandTotal(table.hands[seat]);
+        Money delta = settleBet(table.statusOf(seat), table.bets[seat], playerTotal, dealerTotal, dealerBusted, rules);
+        FUZZ_CHECK(delta * rules.blackjackDen ==
+                   table.bets[seat] * expectedPayout(table.statusOf(seat), playerTotal, dealerTotal, dealerBusted, rules));
+        table.money[seat] += delta;
+        house -= delta;
+    }
+
+    // Each seat sits in exactly the bitmap of its status
+    for (int s = PLAYING; s <= QUIT; ++s) {
+        int listed = 0;
+        for (int seat : table.seats(1u << s)) {
+            FUZZ_CHECK(table.statusOf(seat) == s);
+            listed++;
+        }
+        int counted = 0;
+        for (int seat = 0; seat < table.size(); ++seat) counted += table.statusOf(seat) == s;
+        FUZZ_CHECK(listed == counted);
+    }
+
+    Money after = house;
+    for (int seat = 0; seat < table.size(); ++seat) {
+        FUZZ_CHECK(table.money[seat] >= Money());
+        after += table.money[seat];
+    }
+    FUZZ_CHECK(after == total);
+    return nullptr;
+}
+
+// State reused across inputs, so a fuzzed round does not allocate
+struct FuzzState {
+    SimShoe shoe;
+    SimRound round;
+    SeatTable table;
+    std::vector<Card> deck;
+    Hand dealerHand;
+
+    FuzzState() {
+        for (int seat = 0; seat < TableRules::maxSeats; ++seat) table.addSeat("Seat " + std::to_string(seat + 1), Money());
+    }
+};
+
+// Plays one headless and one table round from an input; null if every check held
+const char* fuzzOneInput(const unsigned char* data, size_t size) {
+    thread_local FuzzState state;
+    FuzzInput input(data, size);
+    unsigned ruleBits = input.byte();
+    RuntimeRules rules;
+    rules.hitSoft17 = (ruleBits & 1) != 0;
+    rules.blackjackNum = (ruleBits & 2) ? 6 : 3;
+    rules.blackjackDen = (ruleBits & 2) ? 5 : 2;
+    rules.reshuffleBelow = 0;
+    if (const char* failure = fuzzSimRound(input, rules, state.shoe, state.round)) return failure;
+    return fuzzTableRound(input, rules, state.table, state.deck, state.dealerHand);
+}
+
+#ifdef BJ_FUZZ
+extern "C" int LLVMFuzzerTestOneInput(const unsigned char* data, size_t size) {
+    if (const char* failure = fuzzOneInput(data, size)) {
+        std::cerr << "Invariant failed: " << failure << std::endl;
+        std::abort();
+    }
+    return 0;
+}
+#endif
+
+// Feeds generated inputs of random length through fuzzOneInput and prints the
+// first input that breaks an invariant, as hex
+int runFuzz(long long inputs, unsigned long long seed) {
+    const size_t FUZZ_MAX_INPUT = 64;
+    Xoshiro256 rng;
+    rng.seed(seed);
+    unsigned char data[FUZZ_MAX_INPUT];
+    auto started = std::chrono::steady_clock::now();
+    for (long long i = 0; i < inputs; ++i) {
+        size_t size = rng() % (FUZZ_MAX_INPUT + 1);
+        for (size_t k = 0; k < size; ++k) data[k] = static_cast<unsigned char>(rng());
+        if (const char* failure = fuzzOneInput(data, size)) {
+            std::cout << "FAIL after " << i << " inputs: " << failure << "\nInput:";
+            char hex[4];
+            for (size_t k = 0; k < size; ++k) {
+                std::snprintf(hex, sizeof(hex), " %02x", data[k]);
+                std::cout << hex;
+            }
+            std::cout << std::endl;
+            return 1;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::cout << std::fixed;
+    std::cout.precision(0);
+    std::cout << inputs << " inputs, " << 2 * inputs << " rounds in ";
+    std::cout.precision(2);
+    std::cout << seconds << " s (";
+    std::cout.precision(0);
+    std::cout << 2 * inputs / std::max(seconds, 1e-9) << " rounds/s)\nPASS" << std::endl;
+    return 0;
+}
+
+// --- EV Tables ---
+// Hit and stand EVs for every decision cell, precomputed offline for each
+// rule set and shoe size and stored in a versioned binary file. The table
+// maps the file and points at the entry for its rules once; a hint is then
+// one read of an eight-byte cell, with nothing parsed or recomputed.
+//
+// Layout: an EvTableHeader, then entryCount EvTableEntry records sorted by
+// key. Everything is fixed-size and native-endian; byteOrder rejects a file
+// written on a machine of the other endianness.
+//
+// EVs are per unit bet, for a player who has already seen the dealer check
+// for Blackjack. The dealer's play is exact for the shoe less the upcard;
+// the player's draws use that shoe's proportions without removing the
+// player's own cards.
+
+const char EV_TABLE_MAGIC[8] = {'B', 'J', 'E', 'V', 'T', 'A', 'B', 0};
+const unsigned EV_TABLE_VERSION = 1;
+const unsigned EV_TABLE_BYTE_ORDER = 0x01020304;
+
+// Cells: player total 2..21, hard or soft, dealer upcard value 2..11 (Ace 11)
+const int EV_TOTALS = 20;
+const int EV_UPCARDS = 10;
+const int EV_CELLS = EV_TOTALS * 2 * EV_UPCARDS;
+const int EV_TABLE_DECKS[] = {1, 2, 4, 6, 8};
+
+struct EvTableHeader {
+    char magic[8];
+    unsigned version;
+    unsigned byteOrder;
+    unsigned headerSize;
+    unsigned entrySize;
+    unsigned entryCount;
+    unsigned reserved;
+};
+
+// The rule settings that change a hit/stand decision. The Blackjack payout
+// does not: a player with Blackjack never decides.
+struct EvTableKey {
+    unsigned char hitSoft17;
+    unsigned char decks;
+    unsigned char reserved[2];
+};
+
+struct EvCell {
+    float stand;
+    float hit; // Hitting, then playing on perfectly
+};
+
+struct EvTableEntry {
+    EvTableKey key;
+    EvCell cells[EV_CELLS];
+};
+
+inline int evCellIndex(int total, bool soft, int upcard) {
+    return ((soft ? EV_TOTALS : 0) + total - 2) * EV_UPCARDS + upcard - 2;
+}
+
+// Cards left in a shoe, by value 2..11 (Ace 11), indexed value - 2
+struct EvShoe {
+    int counts[10];
+    int total;
+
+    double p(int value) const { return static_cast<double>(counts[value - 2]) / total; }
+    void take(int value) {
+        counts[value - 2]--;
+        total--;
+    }
+    void put(int value) {
+        counts[value - 2]++;
+        total++;
+    }
+};
+
+// Probability of each dealer finish: 17..21 at 0..4, bust at 5
+struct EvDealerOdds {
+    double p[6] = {};
+};
+
+// Walks every card sequence the dealer can draw from this shoe
+void addDealerDraws(EvShoe& shoe, int hard, bool hasAce, double weight, const RuntimeRules& rules, EvDealerOdds& odds) {
+    int total = referenceTotal(hard, hasAce);
+    bool hits = total < 17 || (rules.hitSoft17 && total == 17 && referenceSoft(hard, hasAce));
+    if (!hits) {
+        odds.p[total > 21 ? 5 : total - 17] += weight;
+        return;
+    }
+    for (int value = 2; value <= 11; ++value) {
+        if (shoe.counts[value - 2] == 0) continue;
+        double p = shoe.p(value);
+        shoe.take(value);
+        addDealerDraws(shoe, hard + (value == 11 ? 1 : value), hasAce || value == 11, weight * p, rules, odds);
+        shoe.put(value);
+    }
+}
+
+// Dealer odds for an upcard, given the hole card does not make Blackjack
+EvDealerOdds dealerOddsWithoutBlackjack(EvShoe shoe, int upcard, const RuntimeRules& rules) {
+    EvDealerOdds odds;
+    shoe.take(upcard);
+    double excluded = upcard == 11 ? shoe.p(10) : (upcard == 10 ? shoe.p(11) : 0.0);
+    for (int hole = 2; hole <= 11; ++hole) {
+        if (shoe.counts[hole - 2] == 0 || upcard + hole == 21) continue;
+        double p = shoe.p(hole) / (1.0 - excluded);
+        shoe.take(hole);
+        int hard = (upcard == 11 ? 1 : upcard) + (hole == 11 ? 1 : hole);
+        addDealerDraws(shoe, hard, upcard == 11 || hole == 11, p, rules, odds);
+        shoe.put(hole);
+    }
+    return odds;
+}
+
+double standEv(int total, const EvDealerOdds& odds) {
+    double ev = odds.p[5];
+    for (int k = 0; k < 5; ++k) {
+        int dealer = 17 + k;
+        ev += odds.p[k] * (total > dealer ? 1.0 : (total < dealer ? -1.0 : 0.0));
+    }
+    return ev;
+}
+
+// Fills one entry: stand EVs from the dealer odds, hit EVs by walking hard
+// totals down from 21, since a hit only ever raises the hard total
+void buildEvEntry(EvTableEntry& entry, bool hitSoft17, int decks) {
+    entry = {};
+    entry.key.hitSoft17 = hitSoft17 ? 1 : 0;
+    entry.key.decks = static_cast<unsigned char>(decks);
+    RuntimeRules rules;
+    rules.hitSoft17 = hitSoft17;
+
+    EvShoe full = {};
+    for (int value = 2; value <= 11; ++value) full.counts[value - 2] = 4 * decks * (value == 10 ? 4 : 1);
+    full.total = 52 * decks;
+
+    for (int upcard = 2; upcard <= 11; ++upcard) {
+        EvDealerOdds odds = dealerOddsWithoutBlackjack(full, upcard, rules);
+        EvShoe rest = full;
+        rest.take(upcard);
+        // best[hard][ace]: EV of playing on perfectly from that hand
+        double best[22][2];
+        double hit[22][2];
+        for (int hard = 21; hard >= 2; --hard) {
+            for (int ace = 0; ace < 2; ++ace) {
+                double ev = 0.0;
+                for (int value = 2; value <= 11; ++value) {
+                    int next = hard + (value == 11 ? 1 : value);
+                    ev += rest.p(value) * (next > 21 ? -1.0 : best[next][ace || value == 11]);
+                }
+                hit[hard][ace] = ev;
+                best[hard][ace] = std::max(ev, standEv(referenceTotal(hard, ace != 0), odds));
+            }
+        }
+        for (int total = 2; total <= 21; ++total) {
+            for (int soft = 0; soft < 2; ++soft) {
+                // A soft total counts one Ace as 11; hard totals 2 and 3 cannot occur, nor soft below 12
+                int hard = soft ? total - 10 : total;
+                if (hard < 2) continue;
+                EvCell& cell = entry.cells[evCellIndex(total, soft != 0, upcard)];
+                cell.stand = static_cast<float>(standEv(total, odds));
+                cell.hit = static_cast<float>(hit[hard][soft]);
+            }
+        }
+    }
+}
+
+// Writes every rule set and shoe size the engine uses
+int generateEvTable(const std::string& path) {
+    std::vector<EvTableEntry> entries;
+    for (int h17 = 0; h17 < 2; ++h17) {
+        for (int decks : EV_TABLE_DECKS) {
+            entries.emplace_back();
+            buildEvEntry(entries.back(), h17 != 0, decks);
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [](const EvTableEntry& a, const EvTableEntry& b) {
+        return a.key.hitSoft17 != b.key.hitSoft17 ? a.key.hitSoft17 < b.key.hitSoft17 : a.key.decks < b.key.decks;
+    });
+
+    EvTableHeader header = {};
+    std::memcpy(header.magic, EV_TABLE_MAGIC, sizeof(header.magic));
+    header.version = EV_TABLE_VERSION;
+    header.byteOrder = EV_TABLE_BYTE_ORDER;
+    header.headerSize = sizeof(EvTableHeader);
+    header.entrySize = sizeof(EvTableEntry);
+    header.entryCount = static_cast<unsigned>(entries.size());
+
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(EvTableEntry));
+        if (!out) {
+            std::cerr << "Cannot write " << tmpPath << std::endl;
+            return 1;
+        }
+    }
+    std::rename(tmpPath.c_str(), path.c_str());
+
+    std::cout << "Wrote " << entries.size() << " rule sets (" << sizeof(header) + entries.size() * sizeof(EvTableEntry)
+              << " bytes) to " << path << std::endl;
+    // How far basic strategy, which ignores deck count and H17, is from each entry
+    for (const EvTableEntry& entry : entries) {
+        int differ = 0;
+        for (int upcard = 2; upcard <= 11; ++upcard) {
+            for (int total = 4; total <= 21; ++total) {
+                for (int soft = 0; soft < 2; ++soft) {
+                    if (soft && total < 12) continue;
+                    const EvCell& cell = entry.cells[evCellIndex(total, soft != 0, upcard)];
+                    differ += (cell.hit > cell.stand) != shouldHit(STRATEGY_BASIC, total, soft != 0, upcard);
+                }
+            }
+        }
+        std::cout << "  " << (entry.key.hitSoft17 ? "H17" : "S17") << ", " << static_cast<int>(entry.key.decks)
+                  << " deck(s): " << differ << " cell(s) differ from basic strategy" << std::endl;
+    }
+    return 0;
+}
+
+// A read-only view of an EV table file, mapped rather than read where possible
+class EvTable {
+public:
+    EvTable() = default;
+    EvTable(const EvTable&) = delete;
+    EvTable& operator=(const EvTable&) = delete;
+    ~EvTable() { close(); }
+
+    bool open(const std::string& path, std::string& error) {
+        close();
+#ifdef EV_TABLE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error = "cannot open " + path;
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                base = static_cast<const unsigned char*>(mapped);
+                size = static_cast<size_t>(info.st_size);
+            }
+        }
+        ::close(fd);
+        if (base == nullptr) {
+            error = "cannot map " + path;
+            return false;
+        }
+#else
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            error = "cannot open " + path;
+            return false;
+        }
+        copy.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        base = reinterpret_cast<const unsigned char*>(copy.data());
+        size = copy.size();
+#endif
+        const EvTableHeader* header = reinterpret_cast<const EvTableHeader*>(base);
+        if (size < sizeof(EvTableHeader) || std::memcmp(header->magic, EV_TABLE_MAGIC, sizeof(EV_TABLE_MAGIC)) != 0) {
+            error = path + " is not an EV table";
+        } else if (header->byteOrder != EV_TABLE_BYTE_ORDER) {
+            error = path + " was written with the other byte order";
+        } else if (header->version != EV_TABLE_VERSION || header->headerSize != sizeof(EvTableHeader) ||
+                   header->entrySize != sizeof(EvTableEntry)) {
+            error = path + " is EV table version " + std::to_string(header->version) + "; this build reads version " +
+                    std::to_string(EV_TABLE_VERSION) + ". Regenerate it with --gen-ev-table.";
+        } else if (size < sizeof(EvTableHeader) + static_cast<size_t>(header->entryCount) * sizeof(EvTableEntry)) {
+            error = path + " is truncated";
+        } else {
+            entries = reinterpret_cast<const EvTableEntry*>(base + sizeof(EvTableHeader));
+            entryCount = header->entryCount;
+            return true;
+        }
+        close();
+        return false;
+    }
+
+    // The entry for a rule set and shoe size; null if the file has none
+    const EvTableEntry* find(const RuntimeRules& rules, int decks) const {
+        for (unsigned k = 0; k < entryCount; ++k) {
+            if (entries[k].key.hitSoft17 == (rules.hitSoft17 ? 1 : 0) && entries[k].key.decks == decks) return &entries[k];
+        }
+        return nullptr;
+    }
+
+private:
+    void close() {
+#ifdef EV_TABLE_MMAP
+        if (base != nullptr) munmap(const_cast<unsigned char*>(base), size);
+#else
+        copy.clear();
+#endif
+        base = nullptr;
+        size = 0;
+        entries = nullptr;
+        entryCount = 0;
+    }
+
+    const unsigned char* base = nullptr;
+    size_t size = 0;
+    const EvTableEntry* entries = nullptr;
+    unsigned entryCount = 0;
+#ifndef EV_TABLE_MMAP
+    std::string copy;
+#endif
+};
+
+// Suggestion shown beside the Hit/Stand prompt, e.g. "Hit (EV hit -0.21, stand -0.54)"
+std::string evHint(const EvTableEntry& entry, const Hand& hand, int upcard) {
+    const EvCell& cell = entry.cells[evCellIndex(calculateHandTotal(hand), isSoftHand(hand), upcard)];
+    char text[64];
+    std::snprintf(text, sizeof(text), "%s (EV hit %+.3f, stand %+.3f)", cell.hit > cell.stand ? "Hit" : "Stand",
+                  cell.hit, cell.stand);
+    return text;
+}
+
+// --- Benchmarks ---
+
+// Results are folded in here so the optimizer cannot drop the measured work
+volatile int benchSink = 0;
+
+// An explicit load and store: compound assignment to a volatile is deprecated in C++20
+inline void benchKeep(int value) {
+    benchSink = benchSink + value;
+}
+
+// Times only the code between start() and stop(); may be resumed across chunks
+struct BenchTimer {
+    std::chrono::steady_clock::time_point began;
+    unsigned long long allocationsAtStart = 0;
+    double seconds = 0.0;
+    unsigned long long allocations = 0;
+
+    void reset() {
+        seconds = 0.0;
+        allocations = 0;
+    }
+    void start() {
+        allocationsAtStart = threadAllocations;
+        began = std::chrono::steady_clock::now();
+    }
+    void stop() {
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+        allocations += threadAllocations - allocationsAtStart;
+    }
+};
+
+struct BenchResult {
+    const char* name;
+    const char* unit;
+    long long ops;
+    double seconds;
+    unsigned long long allocations;
+
+    double nsPerOp() const { return seconds * 1e9 / ops; }
+    double allocsPerOp() const { return static_cast<double>(allocations) / ops; }
+    double opsPerSec() const { return seconds > 0.0 ? ops / seconds : 0.0; }
+};
+
+// Grows the operation count until one run lasts at least minSeconds
+template <typename Body>
+BenchResult runBench(const char* name, const char* unit, double minSeconds, Body body) {
+    long long ops = 1;
+    BenchTimer timer;
+    while (true) {
+        timer.reset();
+        body(ops, timer);
+        if (timer.seconds >= minSeconds || ops >= (1LL << 40)) break;
+        double scale = timer.seconds > 0.0 ? 1.2 * minSeconds / timer.seconds : 100.0;
+        ops = std::max(ops * 2, static_cast<long long>(ops * std::min(scale, 100.0)));
+    }
+    return {name, unit, ops, timer.seconds, timer.allocations};
+}
+
+std::vector<BenchResult> runBenchmarks(double minSeconds) {
+    std::vector<BenchResult> results;
+
+    results.push_back(runBench("createDeck", "op", minSeconds, [](long long ops, BenchTimer& timer) {
+        std::vector<Card> deck;
+        createDeck(deck);
+        timer.start();
+        for (long long i = 0; i < ops; ++i) {
+            createDeck(deck);
+            benchKeep(deck[0].value);
+        }
+        timer.stop();
+    }));
+
+    results.push_back(runBench("shuffleDeck", "op", minSeconds, [](long long ops, BenchTimer& timer) {
+        std::vector<Card> deck;
+        createDeck(deck);
+        timer.start();
+        for (long long i = 0; i < ops; ++i) {
+            shuffleDeck(deck);
+            benchKeep(deck[0].value);
+        }
+        timer.stop();
+    }));
+
+    results.push_back(runBench("shuffleDeck 8-deck", "op", minSeconds, [](long long ops, BenchTimer& timer) {
+        std::vector<Card> shoe;
+        createShoe(shoe, 8);
+        timer.start();
+        for (long long i = 0; i < ops; ++i) {
+            shuffleDeck(shoe);
+            benchKeep(shoe[0].value);
+        }
+        timer.stop();
+    }));
+
+    results.push_back(runBench("fastShuffle", "op", minSeconds, [](long long ops, BenchTimer& timer) {
+        std::vector<Card> deck;
+        createDeck(deck);
+        Xoshiro256 rng;
+        rng.seed(1);
+        timer.start();
+        for (long long i = 0; i < ops; ++i) {
+            fastShuffle(deck.data(), deck.size(), rng);
+            benchKeep(deck[0].value);
+        }
+        timer.stop();
+    }));
+
+    results.push_back(runBench("fastShuffle 8-deck", "op", minSeconds, [](long long ops, BenchTimer& timer) {
+        std::vector<Card> shoe;
+        createShoe(shoe, 8);
+        Xoshiro256 rng;
+        rng.seed(1);
+        timer.start();
+        for (long long i = 0; i < ops; ++i) {
+            fastShuffle(shoe.data(), shoe.size(), rng);
+            benchKeep(shoe[0].value);
+        }
+        timer.stop();
+    }));
+
+    // Deals from a long pre-built buffer so checkDeck never fires inside the timed loop
+    results.push_back(runBench("dealCard", "op", minSeconds, [](long long ops, BenchTimer& timer) {
+        const long long chunk = 1 << 20;
+        std::vector<Card> pattern;
+        createDeck(pattern);
+        std::vector<Card> deck;
+        deck.reserve(chunk + 20);
+        for (long long done = 0; done < ops; done += chunk) {
+            long long count = std::min(chunk, ops - done);
+            deck.clear();
+            for (long long c = 0; c < count + 20; ++c) deck.push_back(pattern[c % 52]);
+            timer.start();
+            for (long long i = 0; i < count; ++i) {
+                benchKeep(dealCard(deck).value);
+            }
+            timer.stop();
+        }
+    }));
+
+    results.push_back(runBench("calculateHandTotal", "op", minSeconds, [](long long ops, BenchTimer& timer) {
+        SimConfig cfg;
+        SimShoe shoe;
+        startSimTrial(shoe, cfg, 0, false);
+        std::vector<Hand> hands(1024);
+        for (size_t h = 0; h < hands.size(); ++h) {
+            int cards = 2 + static_cast<int>(h % 5);
+            for (int c = 0; c < cards; ++c) hands[h].push_back(drawSimCard(shoe));
+        }
+        timer.start();
+        for (long long i = 0; i < ops; ++i) {
+            benchKeep(calculateHandTotal(hands[i & 1023]));
+        }
+        timer.stop();
+    }));
+
+    results.push_back(runBench("checkDeck reshuffle", "op", minSeconds, [](long long ops, BenchTimer& timer) {
+        std::vector<Card> deck;
+        createDeck(deck);
+        timer.start();
+        for (long long i = 0; i < ops; ++i) {
+            deck.resize(19);
+            checkDeck(deck, false);
+            benchKeep(deck[0].value);
+        }
+        timer.stop();
+    }));
+
+    results.push_back(runBench("headless round", "hand", minSeconds, [](long long ops, BenchTimer& timer) {
+        SimConfig cfg;
+        SimShoe shoe;
+        SimRound round;
+        startSimTrial(shoe, cfg, 0, false);
+        double net = 0.0;
+        timer.start();
+        for (long long i = 0; i < ops; ++i) {
+            net += playSimRound(shoe, round, STRATEGY_BASIC);
+        }
+        timer.stop();
+        benchKeep(static_cast<int>(net));
+    }));
+
+    results.push_back(runBench("headless round runtime", "hand", minSeconds, [](long long ops, BenchTimer& timer) {
+        SimConfig cfg;
+        SimShoe shoe;
+        SimRound round;
+        startSimTrial(shoe, cfg, 0, false);
+        double net = 0.0;
+        timer.start();
+        for (long long i = 0; i < ops; ++i) {
+            net += playSimRound(shoe, round, STRATEGY_BASIC, cfg.rules);
+        }
+        timer.stop();
+        benchKeep(static_cast<int>(net));
+    }));
+
+    return results;
+}
+
+void printBenchmarksJson(const std::vector<BenchResult>& results) {
+    std::cout << std::fixed;
+    std::cout.precision(3);
+    std::cout << "{\n  \"compiler\": \"" << __VERSION__ << "\",\n";
+#ifdef NDEBUG
+    std::cout << "  \"assertions\": false,\n";
+#else
+    std::cout << "  \"assertions\": true,\n";
+#endif
+    std::cout << "  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        std::cout << "    {\"name\": \"" << r.name << "\", \"unit\": \"" << r.unit << "\", \"ops\": " << r.ops
+                  << ", \"ns_per_op\": " << r.nsPerOp() << ", \"allocs_per_op\": " << r.allocsPerOp()
+                  << ", \"ops_per_sec\": " << r.opsPerSec() << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    std::cout << "  ]\n}" << std::endl;
+}
+
+int runBenchmarkSuite(bool json, double minSeconds) {
+    std::vector<BenchResult> results = runBenchmarks(minSeconds);
+    if (json) {
+        printBenchmarksJson(results);
+        return 0;
+    }
+
+    std::cout << "--- BENCHMARKS ---" << std::endl;
+    for (const BenchResult& r : results) {
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-22s %12.1f ns/%-5s %8.2f allocs/%-5s %14.0f %ss/sec",
+                      r.name, r.nsPerOp(), r.unit, r.allocsPerOp(), r.unit, r.opsPerSec(), r.unit);
+        std::cout << line << std::endl;
+    }
+    return 0;
+}
+
+// --- Shuffle Quality ---
+// Statistical harness for every shuffle backend. Shuffles run in fixed-size
+// blocks seeded from the block index, so the counts (and every z-score) are
+// the same on any number of threads. Each backend is timed in the same run,
+// so a faster shuffle is only accepted together with its fairness numbers.
+
+// Chi-square statistic reduced to a z-score, so one threshold fits any degrees of freedom
+double chiSquareZ(double chiSquare, double dof) {
+    return (chiSquare - dof) / std::sqrt(2.0 * dof);
+}
+
+// Generators a backend may draw from, seeded together per block
+struct ShuffleRngs {
+    Xoshiro256 xoshiro;
+    std::mt19937 mt;
+
+    void seed(unsigned long long value) {
+        xoshiro.seed(value);
+        mt.seed(static_cast<unsigned>(value ^ (value >> 32)));
+    }
+};
+
+struct ShuffleBackend {
+    const char* name;
+    bool biasedControl; // Known-bad shuffle the harness has to reject
+    void (*shuffle)(Card* deck, int n, ShuffleRngs& rngs);
+};
+
+const ShuffleBackend SHUFFLE_BACKENDS[] = {
+    {"fastShuffle", false, [](Card* deck, int n, ShuffleRngs& rngs) { fastShuffle(deck, n, rngs.xoshiro); }},
+    // What shuffleDeck does at the table
+    {"std-mt19937", false, [](Card* deck, int n, ShuffleRngs& rngs) { std::shuffle(deck, deck + n, rngs.mt); }},
+    // Swaps every position with any position: n^n equally likely paths onto n! orderings
+    {"naive-swap", true, [](Card* deck, int n, ShuffleRngs& rngs) {
+         for (int i = 0; i < n; ++i) std::swap(deck[i], deck[rngs.mt() % n]);
+     }},
+};
+
+const int SHUFFLE_DECK = 52;
+const long long SHUFFLE_BLOCK = 1 << 14;
+
+struct ShuffleCounts {
+    std::vector<long long> positions;  // card * n + position
+    std::vector<long long> adjacent;   // card * n + the card right after it
+    long long orderings[24] = {};      // 4-card decks by Lehmer code
+    RunningStats risingSequences;
+    long long shuffles = 0;
+
+    ShuffleCounts() : positions(SHUFFLE_DECK * SHUFFLE_DECK, 0), adjacent(SHUFFLE_DECK * SHUFFLE_DECK, 0) {}
+
+    void merge(const ShuffleCounts& other) {
+        for (size_t k = 0; k < positions.size(); ++k) positions[k] += other.positions[k];
+        for (size_t k = 0; k < adjacent.size(); ++k) adjacent[k] += other.adjacent[k];
+        for (int k = 0; k < 24; ++k) orderings[k] += other.orderings[k];
+        risingSequences.merge(other.risingSequences);
+        shuffles += other.shuffles;
+    }
+};
+
+// Shuffles one block of 52-card decks (and as many 4-card decks) into counts
+void countShuffleBlock(const ShuffleBackend& backend, unsigned long long seed, long long block, long long shuffles,
+                       ShuffleCounts& counts) {
+    const int n = SHUFFLE_DECK;
+    ShuffleRngs rngs;
+    rngs.seed((seed << 32) ^ static_cast<unsigned long long>(block) * 0x9E3779B97F4A7C15ULL);
+    Card deck[SHUFFLE_DECK];
+    int positionOf[SHUFFLE_DECK];
+    for (long long k = 0; k < shuffles; ++k) {
+        for (int c = 0; c < n; ++c) deck[c].rank = static_cast<unsigned char>(c);
+        backend.shuffle(deck, n, rngs);
+        for (int pos = 0; pos < n; ++pos) {
+            counts.positions[deck[pos].rank * n + pos]++;
+            positionOf[deck[pos].rank] = pos;
+            if (pos + 1 < n) counts.adjacent[deck[pos].rank * n + deck[pos + 1].rank]++;
+        }
+        // Rising sequences: 1 + the number of cards lying after their successor
+        int rising = 1;
+        for (int c = 0; c + 1 < n; ++c) rising += positionOf[c + 1] < positionOf[c];
+        counts.risingSequences.add(rising);
+
+        Card small[4];
+        for (int c = 0; c < 4; ++c) small[c].rank = static_cast<unsigned char>(c);
+        backend.shuffle(small, 4, rngs);
+        int code = 0; // Lehmer code of the permutation
+        for (int a = 0; a < 4; ++a) {
+            int smaller = 0;
+            for (int b = a + 1; b < 4; ++b) smaller += small[b].rank < small[a].rank;
+            code = code * (4 - a) + smaller;
+        }
+        counts.orderings[code]++;
+    }
+    counts.shuffles += shuffles;
+}
+
+struct ShuffleVerdict {
+    double positionZ, adjacencyZ, risingZ, orderingZ;
+    double shufflesPerSecond;
+};
+
+ShuffleVerdict testShuffleBackend(const ShuffleBackend& backend, long long shuffles, unsigned long long seed,
+                                  int threads) {
+    long long blocks = (shuffles + SHUFFLE_BLOCK - 1) / SHUFFLE_BLOCK;
+    std::vector<ShuffleCounts> partial(threads);
+    auto started = std::chrono::steady_clock::now();
+    parallelFor(blocks, threads, [&](int t, long long begin, long long end) {
+        for (long long block = begin; block < end; ++block) {
+            long long count = std::min(SHUFFLE_BLOCK, shuffles - block * SHUFFLE_BLOCK);
+            countShuffleBlock(backend, seed, block, count, partial[t]);
+        }
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    ShuffleCounts total;
+    for (const auto& p : partial) total.merge(p);
+    const int n = SHUFFLE_DECK;
+    double s = static_cast<double>(total.shuffles);
+
+    ShuffleVerdict verdict;
+    // Every shuffle adds a whole permutation matrix, which makes the statistic
+    // n / (n - 1) times a chi-square with (n - 1)^2 degrees of freedom
+    double expected = s / n;
+    double chiSquare = 0.0;
+    for (long long observed : total.positions) chiSquare += (observed - expected) * (observed - expected) / expected;
+    verdict.positionZ = chiSquareZ(chiSquare * (n - 1) / n, static_cast<double>(n - 1) * (n - 1));
+
+    // Each of the n - 1 neighbouring slots holds any ordered pair of distinct cards
+    // with probability 1 / (n (n - 1)), so every off-diagonal cell expects s / n
+    chiSquare = 0.0;
+    for (int a = 0; a < n; ++a) {
+        for (int b = 0; b < n; ++b) {
+            if (a == b) continue;
+            double observed = static_cast<double>(total.adjacent[a * n + b]);
+            chiSquare += (observed - expected) * (observed - expected) / expected;
+        }
+    }
+    verdict.adjacencyZ = chiSquareZ(chiSquare, static_cast<double>(n - 1) * (n - 1));
+
+    // Rising sequences of a uniform permutation: mean (n + 1) / 2, variance (n + 1) / 12
+    verdict.risingZ = (total.risingSequences.mean() - (n + 1) / 2.0) / std::sqrt((n + 1) / 12.0 / s);
+
+    chiSquare = 0.0;
+    for (long long observed : total.orderings) {
+        chiSquare += (observed - s / 24.0) * (observed - s / 24.0) / (s / 24.0);
+    }
+    verdict.orderingZ = chiSquareZ(chiSquare, 23.0);
+    verdict.shufflesPerSecond = s / seconds;
+    return verdict;
+}
+
+// Runs the harness over every backend, or the one named. Honest backends must
+// pass every test, and the biased control must fail one, or the harness is
+// not sensitive enough at this sample size.
+int runShuffleCheck(long long shuffles, unsigned long long seed, int requestedThreads, const std::string& only) {
+    const double limit = 4.0;
+    int threads = workerCount(requestedThreads);
+    bool ok = true;
+    bool known = only.empty();
+    for (const ShuffleBackend& backend : SHUFFLE_BACKENDS) known = known || only == backend.name;
+    if (!known) {
+        std::cerr << "Unknown shuffle backend: " << only << std::endl;
+        return 1;
+    }
+    std::cout << std::fixed;
+    std::cout.precision(2);
+    std::cout << "--- SHUFFLE QUALITY (" << shuffles << " x 52-card and 4-card shuffles per backend, " << threads
+              << " thread(s); pass if |z| < " << limit << ") ---" << std::endl;
+    std::cout << "backend               positions  adjacency     rising  orderings   Mshuffles/s  result" << std::endl;
+    for (const ShuffleBackend& backend : SHUFFLE_BACKENDS) {
+        if (!only.empty() && only != backend.name) continue;
+        ShuffleVerdict v = testShuffleBackend(backend, shuffles, seed, threads);
+        bool passed = std::fabs(v.positionZ) < limit && std::fabs(v.adjacencyZ) < limit &&
+                      std::fabs(v.risingZ) < limit && std::fabs(v.orderingZ) < limit;
+        const char* result = passed ? "pass" : "FAIL";
+        if (backend.biasedControl) {
+            result = passed ? "NOT DETECTED" : "rejected (control)";
+            if (passed) ok = false;
+        } else if (!passed) {
+            ok = false;
+        }
+        char line[200];
+        std::snprintf(line, sizeof(line), "%-20s %10.2f %10.2f %10.2f %10.2f %13.2f  %s", backend.name, v.positionZ,
+                      v.adjacencyZ, v.risingZ, v.orderingZ, v.shufflesPerSecond / 1e6, result);
+        std::cout << line << std::endl;
+    }
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
+
+// --- Observer Broadcast ---
+// Each phase of a round is published as an immutable snapshot behind a
+// shared_ptr. The table thread builds it, swaps it in and moves on; observers
+// hold their own reference for as long as they read it, so nothing they do
+// can block the table. The JSON form is encoded on first request and cached
+// in the snapshot, so any number of observers share one encode.
+
+enum SnapshotPhase { SNAP_BETTING, SNAP_DEALT, SNAP_DECISION, SNAP_DEALER, SNAP_SETTLED, SNAP_CLOSED };
+const char* const SNAPSHOT_PHASE_NAMES[] = {"betting", "dealt", "decision", "dealer", "settled", "closed"};
+const char* const STATUS_NAMES[] = {"playing", "standing", "busted", "blackjack", "quit"};
+
+std::atomic<long long> snapshotEncodes{0};
+
+struct SeatSnapshot {
+    std::string name;
+    PlayerStatus status;
+    Money balance;
+    Money bet;
+    Hand hand;
+};
+
+class TableSnapshot {
+public:
+    // A hidden hole card is left out, so no observer can see it early
+    TableSnapshot(long long round, SnapshotPhase phase, const SeatTable& table, const Hand& dealerHand,
+                  bool holeHidden)
+        : round(round), phase(phase), holeHidden(holeHidden && !dealerHand.empty()) {
+        for (int k = this->holeHidden ? 1 : 0; k < dealerHand.size(); ++k) dealer.push_back(dealerHand[k]);
+        seats.reserve(table.size());
+        for (int seat = 0; seat < table.size(); ++seat) {
+            seats.push_back({table.names[seat], table.statusOf(seat), table.money[seat], table.bets[seat],
+                             table.hands[seat]});
+        }
+    }
+
+    // One JSON line, built by whichever observer asks first
+    const std::string& encoded() const {
+        std::call_once(encodeOnce, [this] {
+            encodedText = encode();
+            snapshotEncodes.fetch_add(1, std::memory_order_relaxed);
+        });
+        return encodedText;
+    }
+
+    const long long round;
+    const SnapshotPhase phase;
+    const bool holeHidden;
+    unsigned long long version = 0; // Set by SnapshotBus::publish before anyone can read it
+    Hand dealer; // Visible dealer cards only
+    std::vector<SeatSnapshot> seats;
+
+private:
+    static void appendCards(std::string& out, const Hand& hand, bool hidden) {
+        static const char RANK_CODES[] = "A23456789TJQK";
+        static const char SUIT_CODES[] = "HSDC"; // Same order as SUIT_NAMES
+        out += '[';
+        if (hidden) out += "\"??\"";
+        for (int k = 0; k < hand.size(); ++k) {
+            if (hidden || k > 0) out += ',';
+            out += '"';
+            out += RANK_CODES[hand[k].rank];
+            out += SUIT_CODES[hand[k].suit];
+            out += '"';
+        }
+        out += ']';
+    }
+
+    static void appendString(std::string& out, const std::string& text) {
+        out += '"';
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out += escaped;
+            } else {
+                out += c;
+            }
+        }
+        out += '"';
+    }
+
+    std::string encode() const {
+        std::string out = "{\"round\":" + std::to_string(round) + ",\"phase\":\"" + SNAPSHOT_PHASE_NAMES[phase] +
+                          "\",\"dealer\":{\"cards\":";
+        appendCards(out, dealer, holeHidden);
+        out += ",\"total\":";
+        out += holeHidden || dealer.empty() ? "null" : std::to_string(calculateHandTotal(dealer));
+        out += "},\"seats\":[";
+        for (size_t i = 0; i < seats.size(); ++i) {
+            const SeatSnapshot& seat = seats[i];
+            if (i > 0) out += ',';
+            out += "{\"name\":";
+            appendString(out, seat.name);
+            out += ",\"status\":\"" + std::string(STATUS_NAMES[seat.status]) + "\",\"balance\":\"" +
+                   seat.balance.toString() + "\",\"bet\":\"" + seat.bet.toString() + "\",\"cards\":";
+            appendCards(out, seat.hand, false);
+            out += ",\"total\":" + std::to_string(calculateHandTotal(seat.hand)) + "}";
+        }
+        out += "]}\n";
+        return out;
+    }
+
+    mutable std::once_flag encodeOnce;
+    mutable std::string encodedText;
+};
+
+// The latest snapshot, replaced and read without any lock of the table's:
+// an atomic shared_ptr where the library has one, the atomic_load and
+// atomic_store overloads for shared_ptr before that
+class SnapshotSlot {
+public:
+#ifdef __cpp_lib_atomic_shared_ptr
+    std::shared_ptr<const TableSnapshot> load() const { return pointer.load(); }
+    void store(std::shared_ptr<const TableSnapshot> snapshot) { pointer.store(std::move(snapshot)); }
+
+private:
+    std::atomic<std::shared_ptr<const TableSnapshot>> pointer;
+#else
+    std::shared_ptr<const TableSnapshot> load() const { return std::atomic_load(&pointer); }
+    void store(std::shared_ptr<const TableSnapshot> snapshot) { std::atomic_store(&pointer, std::move(snapshot)); }
+
+private:
+    std::shared_ptr<const TableSnapshot> pointer;
+#endif
+};
+
+// Holds the latest snapshot. Each snapshot carries the version it was
+// published as, so a reader always knows exactly what it got; readers that
+// fall behind skip to the newest phase. Reading never locks. The mutex only
+// guards waiting: a waiter counts itself in before its last check, and
+// publish() takes the mutex to notify only when someone is counted, so a
+// wakeup is never lost and the table locks nothing while no one waits.
+class SnapshotBus {
+public:
+    void publish(std::shared_ptr<TableSnapshot> snapshot) {
+        unsigned long long next = version.load(std::memory_order_relaxed) + 1;
+        snapshot->version = next;
+        current.store(std::move(snapshot));
+        version.store(next);
+        wakeWaiters();
+    }
+
+    void close() {
+        closed.store(true);
+        wakeWaiters();
+    }
+
+    std::shared_ptr<const TableSnapshot> latest() const { return current.load(); }
+    unsigned long long published() const { return version.load(); }
+    bool isClosed() const { return closed.load(); }
+
+    // Waits for a snapshot newer than seen and moves seen up to it; null on
+    // timeout or once closed with nothing new
+    std::shared_ptr<const TableSnapshot> waitNewer(unsigned long long& seen, int timeoutMs) {
+        if (version.load() <= seen && !closed.load()) {
+            std::unique_lock<std::mutex> lock(waitMutex);
+            waiters.fetch_add(1);
+            changed.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                             [&] { return version.load() > seen || closed.load(); });
+            waiters.fetch_sub(1);
+        }
+        std::shared_ptr<const TableSnapshot> snapshot = latest();
+        if (!snapshot || snapshot->version <= seen) return nullptr;
+        seen = snapshot->version;
+        return snapshot;
+    }
+
+private:
+    // The store before this is sequentially consistent, as is a waiter's
+    // count before its check: either the waiter sees the change or this
+    // sees the waiter, and then the lock orders the notify after its wait
+    void wakeWaiters() {
+        if (waiters.load() == 0) return;
+        { std::lock_guard<std::mutex> lock(waitMutex); }
+        changed.notify_all();
+    }
+
+    SnapshotSlot current;
+    std::atomic<unsigned long long> version{0}; // Of the newest snapshot in current
+    std::atomic<bool> closed{false};
+    std::atomic<int> waiters{0};
+    std::mutex waitMutex;
+    std::condition_variable changed;
+};
+
+// Streams every snapshot as a JSON line to clients on 127.0.0.1. One thread
+// accepts and writes; a client that cannot take a whole line without blocking
+// is dropped rather than allowed to hold up the others.
+class ObserverServer {
+public:
+    bool start(int port, SnapshotBus& source) {
+#ifdef OBSERVER_SOCKETS
+        bus = &source;
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listenFd < 0) return false;
+        int reuse = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<unsigned short>(port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listenFd, 64) < 0) {
+            ::close(listenFd);
+            listenFd = -1;
+            return false;
+        }
+        fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+        running = true;
+        worker = std::thread([this] { run(); });
+        return true;
+#else
+        (void)port;
+        (void)source;
+        return false;
+#endif
+    }
 
-// --- Necessary Struct and Enum Definitions ---
+    void stop() {
+        if (!worker.joinable()) return;
+        running = false;
+        worker.join();
+#ifdef OBSERVER_SOCKETS
+        for (const Client& client : clients) ::close(client.fd);
+        clients.clear();
+        ::close(listenFd);
+        listenFd = -1;
+#endif
+    }
 
-struct Card {
-    std::string suit;
-    std::string rank;
-    int value;
+    ~ObserverServer() { stop(); }
+
+private:
+#ifdef OBSERVER_SOCKETS
+    struct Client {
+        int fd;
+        unsigned long long sent; // Version of the last snapshot written to it
+    };
+
+    void run() {
+        unsigned long long seen = 0;
+        while (running) {
+            std::shared_ptr<const TableSnapshot> snapshot = bus->waitNewer(seen, 50);
+            acceptPending();
+            if (snapshot) {
+                const std::string& line = snapshot->encoded();
+                // A client accepted just now may already have this one
+                clients.erase(std::remove_if(clients.begin(), clients.end(),
+                                             [&](Client& client) {
+                                                 if (client.sent >= snapshot->version) return false;
+                                                 client.sent = snapshot->version;
+                                                 return !sendLine(client.fd, line);
+                                             }),
+                              clients.end());
+            }
+        }
+    }
+
+    // New clients get the current snapshot straight away
+    void acceptPending() {
+        int fd;
+        while ((fd = accept(listenFd, nullptr, nullptr)) >= 0) {
+            std::shared_ptr<const TableSnapshot> snapshot = bus->latest();
+            if (snapshot && !sendLine(fd, snapshot->encoded())) continue;
+            clients.push_back({fd, snapshot ? snapshot->version : 0});
+        }
+    }
+
+    // Closes the client and returns false unless the whole line went out
+    static bool sendLine(int fd, const std::string& line) {
+        ssize_t sent = send(fd, line.data(), line.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent == static_cast<ssize_t>(line.size())) return true;
+        ::close(fd);
+        return false;
+    }
+
+    int listenFd = -1;
+    std::vector<Client> clients;
+#endif
+    SnapshotBus* bus = nullptr;
+    std::atomic<bool> running{false};
+    std::thread worker;
 };
 
-enum PlayerStatus {
-    PLAYING,  
-    STANDING, 
-    BUSTED,   
-    BLACKJACK,
-    QUIT      
+// Local read-only observers, one thread each, used by the watch mode to show
+// what attaching many spectators costs
+class LocalObservers {
+public:
+    void start(int count, SnapshotBus& source) {
+        attached += count;
+        for (int i = 0; i < count; ++i) {
+            threads.emplace_back([this, &source] {
+                unsigned long long seen = 0;
+                while (!source.isClosed() || source.published() > seen) {
+                    std::shared_ptr<const TableSnapshot> snapshot = source.waitNewer(seen, 100);
+                    if (!snapshot) continue;
+                    bytes.fetch_add(static_cast<long long>(snapshot->encoded().size()), std::memory_order_relaxed);
+                    deliveries.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+        }
+    }
+
+    void join() {
+        for (std::thread& thread : threads) thread.join();
+        threads.clear();
+    }
+
+    int count() const { return attached; }
+    long long delivered() const { return deliveries.load(); }
+    long long bytesRead() const { return bytes.load(); }
+
+private:
+    std::vector<std::thread> threads;
+    int attached = 0;
+    std::atomic<long long> deliveries{0};
+    std::atomic<long long> bytes{0};
 };
 
-struct Player {
-    std::string name;
-    std::vector<Card> hand;
-    int money;
-    int currentBet;
-    PlayerStatus status;
+// --- Terminal Table View ---
+// Full-screen table drawn into a cell buffer. Each frame is composed from
+// scratch into the back buffer, then only the cells that differ from what the
+// terminal already shows are written, with ANSI cursor moves between runs.
+// Card faces come from an atlas built once, so drawing a card is a cell copy.
+
+enum CellColor { COLOR_DEFAULT, COLOR_RED, COLOR_GREEN, COLOR_YELLOW, COLOR_BLUE, COLOR_MAGENTA, COLOR_CYAN, COLOR_DIM };
+const char* const COLOR_SGR[] = {"\x1b[0m", "\x1b[0;31m", "\x1b[0;32m", "\x1b[0;33m",
+                                 "\x1b[0;34m", "\x1b[0;35m", "\x1b[0;36m", "\x1b[0;2m"};
+
+// One screen cell: a UTF-8 glyph of up to four bytes and its color
+struct Cell {
+    char glyph[4];
+    unsigned char length;
+    unsigned char color;
+
+    bool operator==(const Cell& other) const {
+        return length == other.length && color == other.color && std::memcmp(glyph, other.glyph, length) == 0;
+    }
+    bool operator!=(const Cell& other) const { return !(*this == other); }
 };
 
-// --- Helper Functions ---
+constexpr Cell makeCell(const char* utf8, unsigned char color = COLOR_DEFAULT) {
+    Cell cell = {};
+    unsigned char lead = static_cast<unsigned char>(utf8[0]);
+    cell.length = lead < 0x80 ? 1 : (lead < 0xE0 ? 2 : (lead < 0xF0 ? 3 : 4));
+    for (int i = 0; i < cell.length; ++i) cell.glyph[i] = utf8[i];
+    cell.color = color;
+    return cell;
+}
+
+constexpr const char* SUIT_SYMBOLS[] = {"♥", "♠", "♦", "♣"}; // Same order as SUIT_NAMES
+constexpr const char* RANK_SHORT[] = {"A", "2", "3", "4", "5", "6", "7", "8", "9", "10", "J", "Q", "K"};
+
+const int SPRITE_ROWS = 5;
+const int SPRITE_COLS = 5;
+const int MINI_COLS = 3;
+
+struct CardSprite {
+    Cell big[SPRITE_ROWS][SPRITE_COLS] = {}; // The boxed card from the visual table prototype
+    Cell mini[MINI_COLS] = {};               // Inline form, e.g. "10♠" or "A♥ "
+};
+
+// Sprites for the 52 card codes plus the face-down back, drawn at compile time
+class CardAtlas {
+public:
+    static const int BACK = CARD_CODES;
+
+    constexpr CardAtlas() {
+        for (int code = 0; code < CARD_CODES; ++code) build(sprites[code], code / 13, code % 13);
+        const char* const back[SPRITE_ROWS] = {".---.", "|###|", "|###|", "|###|", "'---'"};
+        for (int r = 0; r < SPRITE_ROWS; ++r) {
+            for (int c = 0; c < SPRITE_COLS; ++c) {
+                char ch[2] = {back[r][c], 0};
+                sprites[BACK].big[r][c] = makeCell(ch, r == 0 || r == SPRITE_ROWS - 1 ? COLOR_DEFAULT : COLOR_BLUE);
+            }
+        }
+        for (int c = 0; c < MINI_COLS; ++c) sprites[BACK].mini[c] = makeCell("#", COLOR_BLUE);
+    }
+
+    constexpr const CardSprite& operator[](int code) const { return sprites[code]; }
+
+private:
+    static constexpr void build(CardSprite& sprite, int suit, int rank) {
+        unsigned char color = sameColor(suit, 0) ? COLOR_RED : COLOR_DEFAULT;
+        const char* r = RANK_SHORT[rank];
+        bool ten = r[1] != 0;
+        char rows[SPRITE_ROWS][SPRITE_COLS + 1] = {".---.", "|   |", "| * |", "|   |", "'---'"};
+        rows[1][1] = r[0]; // Rank top left and bottom right, "10" taking two cells
+        rows[3][3] = ten ? r[1] : r[0];
+        if (ten) {
+            rows[1][2] = r[1];
+            rows[3][2] = r[0];
+        }
+        for (int row = 0; row < SPRITE_ROWS; ++row) {
+            for (int c = 0; c < SPRITE_COLS; ++c) {
+                char ch[2] = {rows[row][c], 0};
+                bool face = row > 0 && row < SPRITE_ROWS - 1 && c > 0 && c < SPRITE_COLS - 1;
+                sprite.big[row][c] = (ch[0] == '*') ? makeCell(SUIT_SYMBOLS[suit], color)
+                                                    : makeCell(ch, face ? color : static_cast<unsigned char>(COLOR_DEFAULT));
+            }
+        }
+        sprite.mini[0] = makeCell(ten ? "1" : r, color);
+        sprite.mini[1] = ten ? makeCell("0", color) : makeCell(SUIT_SYMBOLS[suit], color);
+        sprite.mini[2] = ten ? makeCell(SUIT_SYMBOLS[suit], color) : makeCell(" ");
+    }
+
+    CardSprite sprites[CARD_CODES + 1] = {};
+};
+
+constexpr CardAtlas CARD_ATLAS;
+
+class ScreenBuffer {
+public:
+    ScreenBuffer(int rows, int cols)
+        : rows(rows), cols(cols), back(rows * cols, makeCell(" ")), front(rows * cols, makeCell(" ")) {}
 
-// Converts card rank to numerical value
-int getCardValue(const std::string& rank) {
-    if (rank == "Jack" || rank == "Queen" || rank == "King") {
-        return 10;
+    void clear() { std::fill(back.begin(), back.end(), makeCell(" ")); }
+
+    void put(int row, int col, const Cell& cell) {
+        if (row >= 0 && row < rows && col >= 0 && col < cols) back[row * cols + col] = cell;
     }
-    if (rank == "Ace") {
-        return 11;
+
+    // ASCII text, cut off after width cells and at the right edge
+    void text(int row, int col, const std::string& str, unsigned char color = COLOR_DEFAULT,
+              size_t width = std::string::npos) {
+        for (size_t k = 0; k < str.size() && k < width; ++k) {
+            char ch[2] = {str[k], 0};
+            put(row, col + static_cast<int>(k), makeCell(ch, color));
+        }
     }
-    try {
-        return std::stoi(rank);
-    } catch (...) {
-        return 0; // Safety return in case of error
+
+    // Takes over the terminal: clears it and hides the cursor
+    void begin() {
+        emit("\x1b[2J\x1b[?25l");
+        std::fill(front.begin(), front.end(), makeCell(" "));
     }
-}
 
-// Creates a standard 52-card deck
-void createDeck(std::vector<Card>& deck) {
-    deck.clear();
-    // English Suit Names
-    std::string suits[] = {"Hearts", "Spades", "Diamonds", "Clubs"};
-    // English Rank Names
-    std::string ranks[] = {"Ace", "2", "3", "4", "5", "6", "7", "8", "9", "10", "Jack", "Queen", "King"};
-    
-    for (const std::string& s : suits) {
-        for (const std::string& r : ranks) {
-            deck.push_back({s, r, getCardValue(r)});
+    // Writes the cells that changed since the last frame
+    void present() {
+        out.clear();
+        int cursorRow = -1, cursorCol = -1, color = -1;
+        char move[32];
+        for (int r = 0; r < rows; ++r) {
+            for (int c = 0; c < cols; ++c) {
+                const Cell& cell = back[r * cols + c];
+                Cell& shown = front[r * cols + c];
+                if (cell == shown) continue;
+                if (r == cursorRow && c > cursorCol && c - cursorCol <= SHORT_GAP) {
+                    // Rewriting a few unchanged cells is shorter than a cursor move
+                    for (int k = cursorCol; k < c; ++k) appendCell(back[r * cols + k], color);
+                } else if (r != cursorRow || c != cursorCol) {
+                    std::snprintf(move, sizeof(move), "\x1b[%d;%dH", r + 1, c + 1);
+                    out += move;
+                }
+                appendCell(cell, color);
+                shown = cell;
+                cursorRow = r;
+                cursorCol = c + 1;
+            }
         }
+        if (color != -1 && color != COLOR_DEFAULT) out += COLOR_SGR[COLOR_DEFAULT];
+        emit(out);
+        frames++;
+    }
+
+    // Hands the terminal back below the table
+    void end() {
+        char move[32];
+        std::snprintf(move, sizeof(move), "\x1b[%d;1H", rows + 1);
+        emit(std::string(COLOR_SGR[COLOR_DEFAULT]) + move + "\x1b[?25h");
+    }
+
+    long long framesDrawn() const { return frames; }
+    long long bytesWritten() const { return bytes; }
+
+private:
+    static const int SHORT_GAP = 3;
+
+    void appendCell(const Cell& cell, int& color) {
+        if (cell.color != color) {
+            out += COLOR_SGR[cell.color];
+            color = cell.color;
+        }
+        out.append(cell.glyph, cell.length);
+    }
+
+    void emit(const std::string& data) {
+        if (data.empty()) return;
+        std::fwrite(data.data(), 1, data.size(), stdout);
+        std::fflush(stdout);
+        bytes += static_cast<long long>(data.size());
+    }
+
+    int rows, cols;
+    std::vector<Cell> back;
+    std::vector<Cell> front;
+    std::string out;
+    long long frames = 0;
+    long long bytes = 0;
+};
+
+// Lays out the dealer, up to seven seats and a status line on an 80-column screen
+class TableView {
+public:
+    static const int COLS = 80;
+    static const int SEAT_TOP = 9;
+    // Seat row columns; every field is clipped to end before the next one
+    static const int NAME_COL = 1, MONEY_COL = 14, BET_COL = 26, CHIPS_COL = 38, RESULT_COL = 60;
+    static const int MAX_CHIPS = 16; // One more cell holds the "+" for a stack that does not fit
+    // Hand row: mini cards from HAND_COL, then the total
+    static const int HAND_COL = 3, TOTAL_COL = 50;
+    // Dealer: big cards from column 1, total on the middle sprite row
+    static const int DEALER_TOTAL_COL = 70;
+
+    explicit TableView(int seats) : screen(SEAT_TOP + 2 * seats + 2, COLS), statusRow(SEAT_TOP + 2 * seats + 1) {}
+
+    void begin() { screen.begin(); }
+    void end() { screen.end(); }
+    const ScreenBuffer& buffer() const { return screen; }
+
+    // results holds a short per-seat note (e.g. "WIN +$5"); empty for none
+    void draw(const SeatTable& table, const Hand& dealerHand, bool holeHidden, const std::vector<std::string>& results,
+              const std::string& status, long long round, int shoeCards) {
+        screen.clear();
+        screen.text(0, 0, " BLACKJACK ", COLOR_YELLOW);
+        screen.text(0, 12, "Round " + std::to_string(round) + "   Shoe: " + std::to_string(shoeCards) + " cards", COLOR_DIM);
+
+        screen.text(2, 1, "Dealer", COLOR_CYAN);
+        const int dealerFits = (DEALER_TOTAL_COL - 1) / (SPRITE_COLS + 1);
+        for (int k = 0; k < dealerHand.size() && k < dealerFits; ++k) {
+            int code = (holeHidden && k == 0) ? CardAtlas::BACK : cardCode(dealerHand[k]);
+            drawBigCard(3, 1 + k * (SPRITE_COLS + 1), CARD_ATLAS[code]);
+        }
+        if (dealerHand.size() > dealerFits) screen.text(5, DEALER_TOTAL_COL - 2, "+");
+        if (!dealerHand.empty()) {
+            std::string total = holeHidden ? "?" : std::to_string(calculateHandTotal(dealerHand));
+            screen.text(5, DEALER_TOTAL_COL, "= " + total);
+        }
+
+        for (int seat = 0; seat < table.size(); ++seat) {
+            int row = SEAT_TOP + 2 * seat;
+            bool gone = table.statusOf(seat) == QUIT;
+            unsigned char nameColor = gone ? COLOR_DIM : COLOR_DEFAULT;
+            screen.text(row, NAME_COL, table.names[seat], nameColor, MONEY_COL - NAME_COL - 1);
+            screen.text(row, MONEY_COL, "$" + table.money[seat].toString(), nameColor, BET_COL - MONEY_COL - 1);
+            if (!gone && table.bets[seat] > Money()) {
+                screen.text(row, BET_COL, "bet $" + table.bets[seat].toString(), COLOR_DEFAULT, CHIPS_COL - BET_COL - 1);
+                drawChips(row, CHIPS_COL, table.bets[seat]);
+            }
+            if (!results[seat].empty()) {
+                const std::string& note = results[seat];
+                unsigned char color = gone ? COLOR_DIM
+                                    : note.find('+') != std::string::npos ? COLOR_GREEN
+                                    : note == "PUSH" ? COLOR_YELLOW : COLOR_RED;
+                screen.text(row, RESULT_COL, results[seat], color, COLS - RESULT_COL);
+            }
+            const Hand& hand = table.hands[seat];
+            if (gone || hand.empty()) continue;
+            // A hand too long for its row shows the cards that fit, then "+"
+            const int handFits = (TOTAL_COL - HAND_COL - 1) / (MINI_COLS + 1);
+            for (int k = 0; k < hand.size() && k < handFits; ++k) {
+                const CardSprite& sprite = CARD_ATLAS[cardCode(hand[k])];
+                for (int c = 0; c < MINI_COLS; ++c) screen.put(row + 1, HAND_COL + k * (MINI_COLS + 1) + c, sprite.mini[c]);
+            }
+            if (hand.size() > handFits) screen.text(row + 1, TOTAL_COL - 2, "+");
+            screen.text(row + 1, TOTAL_COL, "= " + std::to_string(calculateHandTotal(hand)));
+        }
+        screen.text(statusRow, 1, status, COLOR_DIM);
+        screen.present();
+    }
+
+private:
+    void drawBigCard(int row, int col, const CardSprite& sprite) {
+        for (int r = 0; r < SPRITE_ROWS; ++r) {
+            for (int c = 0; c < SPRITE_COLS; ++c) screen.put(row + r, col + c, sprite.big[r][c]);
+        }
+    }
+
+    // One chip per denomination unit, largest first, capped at the space available
+    void drawChips(int row, int col, Money bet) {
+        static const struct { long long dollars; unsigned char color; } chips[] = {
+            {100, COLOR_MAGENTA}, {25, COLOR_GREEN}, {5, COLOR_RED}, {1, COLOR_DEFAULT}};
+        long long left = bet.wholeDollars();
+        int drawn = 0;
+        for (const auto& chip : chips) {
+            for (; left >= chip.dollars; left -= chip.dollars) {
+                if (drawn == MAX_CHIPS) {
+                    screen.text(row, col + drawn, "+");
+                    return;
+                }
+                screen.put(row, col + drawn++, makeCell("●", chip.color));
+            }
+        }
+    }
+
+    ScreenBuffer screen;
+    int statusRow;
+};
+
+struct WatchConfig {
+    int seats = 7;
+    long long rounds = 200;
+    int delayMs = 40;      // Pause after each frame; 0 draws as fast as the terminal takes it
+    int decks = 6;
+    long long bet = 5;     // Flat bet in dollars
+    unsigned seed = 0;     // 0 seeds from the clock
+    int observers = 0;     // Local observer threads reading the snapshots
+    int observePort = 0;   // Also stream snapshots on 127.0.0.1:port; 0 for none
+};
+
+// A bot-driven table shown in the terminal view: every seat plays basic
+// strategy with a flat bet until it cannot cover it
+int runWatch(const WatchConfig& cfg) {
+    SeatTable table;
+    for (int seat = 0; seat < cfg.seats; ++seat) table.addSeat("Bot " + std::to_string(seat + 1), Money::dollars(100));
+    std::vector<std::string> results(cfg.seats);
+
+    Xoshiro256 rng;
+    rng.seed(cfg.seed != 0 ? cfg.seed : std::chrono::steady_clock::now().time_since_epoch().count());
+    std::vector<Card> deck;
+    auto reshuffle = [&] {
+        createShoe(deck, cfg.decks);
+        fastShuffle(deck.data(), deck.size(), rng);
+    };
+    // A hand that runs the shoe dry draws from a fresh one, seeded like the rest
+    auto draw = [&] {
+        if (deck.empty()) {
+            reshuffle();
+            addMetric(METRIC_RESHUFFLES);
+        }
+        Card card = deck.back();
+        deck.pop_back();
+        return card;
+    };
+    reshuffle();
+    const size_t cutCard = std::max(deck.size() / 4, 2 * static_cast<size_t>(cfg.seats + 1));
+
+    TableView view(cfg.seats);
+    Hand dealerHand;
+    bool holeHidden = true;
+    long long round = 0;
+
+    SnapshotBus bus;
+    LocalObservers observers;
+    ObserverServer server;
+    if (cfg.observePort > 0 && !server.start(cfg.observePort, bus)) {
+        std::cerr << "Cannot listen on 127.0.0.1:" << cfg.observePort << std::endl;
+        return 1;
+    }
+    observers.start(cfg.observers, bus);
+    const bool observed = cfg.observers > 0 || cfg.observePort > 0;
+
+    auto frame = [&](SnapshotPhase phase, const std::string& status) {
+        if (observed) bus.publish(std::make_shared<TableSnapshot>(round, phase, table, dealerHand, holeHidden));
+        view.draw(table, dealerHand, holeHidden, results, status, round, static_cast<int>(deck.size()));
+        if (cfg.delayMs > 0) std::this_thread::sleep_for(std::chrono::milliseconds(cfg.delayMs));
+    };
+
+    auto started = std::chrono::steady_clock::now();
+    view.begin();
+    for (round = 1; round <= cfg.rounds; ++round) {
+        if (deck.size() < cutCard) {
+            reshuffle();
+            addMetric(METRIC_RESHUFFLES);
+        }
+        dealerHand.clear();
+        holeHidden = true;
+        int active = 0;
+        for (int seat : table.seats(ACTIVE_SEATS)) {
+            table.hands[seat].clear();
+            results[seat].clear();
+            if (table.money[seat] < Money::dollars(cfg.bet)) {
+                table.bets[seat] = Money();
+                table.setStatus(seat, QUIT);
+                results[seat] = "left";
+                continue;
+            }
+            table.bets[seat] = Money::dollars(cfg.bet);
+            table.setStatus(seat, PLAYING);
+            active++;
+        }
+        if (active == 0) break;
+        frame(SNAP_BETTING, "Bets are in");
+
+        dealInitialCards(deck, table, ACTIVE_SEATS, active, dealerHand, nullptr, false);
+        bool dealerHasBJ = calculateHandTotal(dealerHand) == 21;
+        for (int seat : table.seats(statusBit(PLAYING))) {
+            table.setStatus(seat, initialStatus(calculateHandTotal(table.hands[seat]), dealerHasBJ));
+        }
+        frame(SNAP_DEALT, "Dealing");
+
+        int upcard = dealerHand[1].value;
+        if (!dealerHasBJ) {
+            for (int seat : table.seats(statusBit(PLAYING))) {
+                Hand& hand = table.hands[seat];
+                while (table.statusOf(seat) == PLAYING) {
+                    if (shouldHit(STRATEGY_BASIC, calculateHandTotal(hand), isSoftHand(hand), upcard)) {
+                        hand.push_back(draw());
+                        if (calculateHandTotal(hand) > 21) table.setStatus(seat, BUSTED);
+                        frame(SNAP_DECISION, table.names[seat] + " hits");
+                    } else {
+                        table.setStatus(seat, STANDING);
+                    }
+                }
+            }
+        }
+
+        holeHidden = false;
+        frame(SNAP_DEALER, "Dealer reveals");
+        bool dealerBusted = false;
+        if (table.any(STANDING)) {
+            while (dealerShouldHit(dealerHand)) {
+                dealerHand.push_back(draw());
+                frame(SNAP_DEALER, "Dealer draws");
+            }
+            dealerBusted = calculateHandTotal(dealerHand) > 21;
+        }
+
+        int dealerTotal = calculateHandTotal(dealerHand);
+        for (int seat : table.seats(ACTIVE_SEATS)) {
+            Money delta = settleBet(table.statusOf(seat), table.bets[seat], calculateHandTotal(table.hands[seat]),
+                                    dealerTotal, dealerBusted);
+            table.money[seat] += delta;
+            addMetric(METRIC_HOUSE_NET, -delta.inCents());
+            if (table.statusOf(seat) == BLACKJACK) {
+                results[seat] = "BLACKJACK +$" + delta.toString();
+            } else if (delta > Money()) {
+                results[seat] = "WIN +$" + delta.toString();
+            } else if (delta < Money()) {
+                const char* label = table.statusOf(seat) != BUSTED ? "LOSE -$" : dealerHasBJ ? "DEALER BJ -$" : "BUST -$";
+                results[seat] = label + delta.absolute().toString();
+            } else {
+                results[seat] = "PUSH";
+            }
+        }
+        addMetric(METRIC_ROUNDS);
+        addMetric(METRIC_HANDS_DEALT, active);
+        frame(SNAP_SETTLED, "Round settled");
+    }
+    round = std::min(round, cfg.rounds);
+    frame(SNAP_CLOSED, "Table closed");
+    view.end();
+    bus.close();
+    observers.join();
+    server.stop();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    const ScreenBuffer& screen = view.buffer();
+    std::cout << std::fixed;
+    std::cout.precision(1);
+    std::cout << round << " rounds, " << screen.framesDrawn() << " frames in " << seconds << " s; "
+              << screen.bytesWritten() << " bytes written ("
+              << static_cast<double>(screen.bytesWritten()) / std::max(1LL, screen.framesDrawn()) << " per frame)"
+              << std::endl;
+    if (observers.count() > 0) {
+        std::cout << observers.count() << " observers read " << observers.delivered() << " snapshots ("
+                  << observers.bytesRead() << " bytes); " << bus.published() << " published, "
+                  << snapshotEncodes.load() << " encoded" << std::endl;
     }
+    return 0;
 }
 
-// Shuffles the deck randomly
-void shuffleDeck(std::vector<Card>& deck) {
-    unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-    std::mt19937 g(seed);
-    std::shuffle(deck.begin(), deck.end(), g);
+// --- Command Line ---
+
+void printUsage() {
+    std::cout << "Usage: 21k                      Play at the table\n"
+              << "       21k --simulate [options]  Estimate a strategy's EV\n"
+              << "       21k --compare A B [opts]  Compare two strategies on common shoes\n"
+              << "       21k --bankroll [options]  Risk of ruin over many independent sessions\n"
+              << "       21k --check-alloc         Fail if a steady-state round allocates\n"
+              << "       21k --tournament [--players N] [--seats N] [--rounds N] [--advance N] [--bet N]\n"
+              << "                    [--start N] [--decks N] [--seed N] [--threads N]\n"
+              << "                                 Elimination tournament between bot tables\n"
+              << "       21k --gen-ev-table PATH   Precompute hit/stand EVs for every rule set\n"
+              << "       21k --fuzz [--inputs N] [--seed N]  Random rounds against the engine invariants\n"
+              << "       21k --bench [--json] [--min-time S]  Time the core primitives\n"
+              << "       21k --shuffle-check [--shuffles N] [--backend B] [--seed N] [--threads N]\n"
+              << "                                 Shuffle fairness and throughput for each backend\n"
+              << "       21k --solve [--shoe A,2,..,9,T | --decks N] [--strategy S] [--mc N]\n"
+              << "                                 Exact EV on a small fresh shoe (default one deck)\n"
+              << "       21k --side-bet-odds [--decks N]  Exact side bet house edge by enumeration\n"
+              << "       21k --watch [--seats N] [--rounds N] [--delay MS] [--bet N] [--decks N] [--seed N]\n"
+              << "                   [--observers N] [--observe-port P]\n"
+              << "                                 Watch a bot table in the full-screen terminal view\n"
+              << "Table options: --metrics-file PATH [--metrics-interval S]  Export Prometheus metrics\n"
+              << "               --side-bets  Offer Perfect Pairs and 21+3 when betting\n"
+              << "               --max-seats N  Seats at the table (default 7)\n"
+              << "               --observe-port P  Stream round snapshots as JSON lines on 127.0.0.1:P\n"
+              << "               --ev-table PATH  Suggest a move at the Hit/Stand prompt\n"
+              << "Strategies: basic, dealer, never-bust\n"
+              << "Options:\n"
+              << "  --strategy NAME        Strategy for --simulate (default basic)\n"
+              << "  --hands N              Hands per strategy (default 1000000)\n"
+              << "  --decks N              Decks in the shoe (default 1)\n"
+              << "  --rounds-per-trial N   Rounds played from each fresh shoe (default 100,\n"
+              << "                         1 for --compare so both strategies stay in step)\n"
+              << "  --seed N               Base seed (default 1)\n"
+              << "  --threads N            Worker threads (default: all cores)\n"
+              << "  --antithetic           Pair every shoe with a mirrored one: the same opening\n"
+              << "                         deal, then high and low cards swapped (--compare)\n"
+              << "  --records PATH         Write one record per hand (--simulate)\n"
+              << "  --records-format F     columnar (default) or csv\n"
+              << "  --h17                  Dealer hits soft 17 (default stands on all 17s)\n"
+              << "  --blackjack-pays N:D   Blackjack payout (default 3:2)\n"
+              << "  --reshuffle-at N       Reshuffle when fewer than N cards remain (default 20)\n"
+              << "  --side-bets            Also track unit Perfect Pairs and 21+3 bets (--simulate)\n"
+              << "Bankroll options:\n"
+              << "  --sessions N           Independent sessions (default 100000)\n"
+              << "  --start N              Starting bankroll in units (default 100)\n"
+              << "  --bet N                Flat bet in units (default 1)\n"
+              << "  --bet-fraction F       Bet this fraction of the balance instead\n"
+              << "  --stop-win N           End a session once up N units\n"
+              << "  --stop-loss N          End a session once down N units\n"
+              << "  --max-rounds N         Round cap per session (default 1000)" << std::endl;
 }
 
-// Calculates the total value of a hand, handling Aces (1 or 11)
-int calculateHandTotal(const std::vector<Card>& hand) {
-    int total = 0;
-    int aceCount = 0;
-    for (const Card& card : hand) {
-        total += card.value;
-        if (card.rank == "Ace") {
-            aceCount++;
-        }
+// Reads the numeric value following an option, rejecting values below minimum
+bool readNumberArg(int argc, char* argv[], int& i, long long minimum, long long& out) {
+    if (i + 1 >= argc) {
+        std::cerr << argv[i] << " needs a value." << std::endl;
+        return false;
     }
-    // Adjust Aces if total is over 21
-    while (total > 21 && aceCount > 0) {
-        total -= 10;
-        aceCount--;
+    char* end = nullptr;
+    long long value = std::strtoll(argv[++i], &end, 10);
+    if (*end != '\0' || value < minimum) {
+        std::cerr << "Invalid value for " << argv[i - 1] << ": " << argv[i] << std::endl;
+        return false;
     }
-    return total;
+    out = value;
+    return true;
 }
 
-// Prints a player's hand to the console
-void printHand(const std::string& name, const std::vector<Card>& hand, bool isDealerHidden = false) {
-    std::cout << name << "'s hand: ";
-    if (isDealerHidden) {
-        std::cout << "[HIDDEN CARD] ";
-        std::cout << hand[1].rank << " of " << hand[1].suit << std::endl;
-    } else {
-        for (const Card& card : hand) {
-            std::cout << card.rank << " of " << card.suit << " | ";
+// Reads a shoe as ten counts, Aces first and ten-valued cards last
+bool parseShoeCounts(const std::string& text, ShoeComposition& comp) {
+    ShoeComposition parsed;
+    size_t start = 0;
+    for (int c = 0; c < CARD_CLASSES; ++c) {
+        size_t comma = text.find(',', start);
+        if ((comma == std::string::npos) != (c == CARD_CLASSES - 1)) return false;
+        std::string field = text.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        char* end = nullptr;
+        long count = std::strtol(field.c_str(), &end, 10);
+        if (field.empty() || *end != '\0' || count < 0) return false;
+        parsed.counts[c] = static_cast<int>(count);
+        parsed.total += static_cast<int>(count);
+        start = comma + 1;
+    }
+    comp = parsed;
+    return true;
+}
+
+int runSolverCommand(int argc, char* argv[]) {
+    SolveConfig cfg;
+    for (int c = 0; c < CARD_CLASSES; ++c) cfg.shoe.counts[c] = (c == CARD_CLASSES - 1) ? 16 : 4;
+    cfg.shoe.total = 52;
+
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        long long value = 0;
+        if (arg == "--shoe" && i + 1 < argc) {
+            if (!parseShoeCounts(argv[++i], cfg.shoe)) {
+                std::cerr << "--shoe needs ten counts: A,2,3,4,5,6,7,8,9,T" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--decks") {
+            if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+            cfg.shoe.total = 0;
+            for (int c = 0; c < CARD_CLASSES; ++c) {
+                cfg.shoe.counts[c] = static_cast<int>(value) * (c == CARD_CLASSES - 1 ? 16 : 4);
+                cfg.shoe.total += cfg.shoe.counts[c];
+            }
+        } else if (arg == "--strategy" && i + 1 < argc) {
+            if (!parseStrategy(argv[++i], cfg.strategy)) {
+                std::cerr << "Unknown strategy: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--mc") {
+            if (!readNumberArg(argc, argv, i, 0, value)) return 1;
+            cfg.monteCarloRounds = value;
+        } else if (arg == "--seed") {
+            if (!readNumberArg(argc, argv, i, 0, value)) return 1;
+            cfg.seed = static_cast<unsigned>(value);
+        } else if (arg == "--threads") {
+            if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+            cfg.threads = static_cast<int>(value);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
         }
-        std::cout << "Total: " << calculateHandTotal(hand) << std::endl;
     }
+    return runSolver(cfg);
 }
 
-// Checks if the deck is running low and recreates it if necessary
-void checkDeck(std::vector<Card>& deck) {
-    if (deck.size() < 20) { 
-        std::cout << "\n--- Deck is running low! Creating and shuffling a new deck... ---\n" << std::endl;
-        std::this_thread::sleep_for(std::chrono::milliseconds(1500));
-        createDeck(deck);
-        shuffleDeck(deck);
+int runCommandLine(int argc, char* argv[]) {
+    SimConfig cfg;
+    BankrollConfig bank;
+    std::string mode = argv[1];
+    int i = 2;
+
+    if (mode == "--check-alloc") {
+        return runAllocationCheck();
+    }
+    if (mode == "--solve") {
+        return runSolverCommand(argc, argv);
+    }
+    if (mode == "--tournament") {
+        TournamentConfig tournament;
+        long long value = 0;
+        for (; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--players") {
+                if (!readNumberArg(argc, argv, i, 2, value)) return 1;
+                tournament.players = static_cast<int>(std::min<long long>(value, 10000000));
+            } else if (arg == "--seats") {
+                if (!readNumberArg(argc, argv, i, 2, value)) return 1;
+                tournament.seatsPerTable = static_cast<int>(std::min<long long>(value, TableRules::maxSeats));
+            } else if (arg == "--rounds") {
+                if (!readNumberArg(argc, argv, i, 1, tournament.rounds)) return 1;
+            } else if (arg == "--advance") {
+                if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+                tournament.advance = static_cast<int>(std::min<long long>(value, TableRules::maxSeats));
+            } else if (arg == "--bet") {
+                if (!readNumberArg(argc, argv, i, 1, tournament.bet)) return 1;
+            } else if (arg == "--start") {
+                if (!readNumberArg(argc, argv, i, 1, tournament.bankroll)) return 1;
+            } else if (arg == "--decks") {
+                if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+                tournament.decks = static_cast<int>(std::min<long long>(value, 8));
+            } else if (arg == "--seed") {
+                if (!readNumberArg(argc, argv, i, 0, value)) return 1;
+                tournament.seed = static_cast<unsigned long long>(value);
+            } else if (arg == "--threads") {
+                if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+                tournament.threads = static_cast<int>(value);
+            } else {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return 1;
+            }
+        }
+        // Every table must shrink, or a level could seat the same players again
+        if (2 * tournament.advance > tournament.seatsPerTable) {
+            std::cerr << "--advance must be at most half of --seats." << std::endl;
+            return 1;
+        }
+        if (tournament.bet > tournament.bankroll) {
+            std::cerr << "--bet must not exceed --start." << std::endl;
+            return 1;
+        }
+        return runTournament(tournament);
+    }
+    if (mode == "--gen-ev-table") {
+        if (argc != 3) {
+            std::cerr << "--gen-ev-table needs an output path." << std::endl;
+            return 1;
+        }
+        return generateEvTable(argv[2]);
+    }
+    if (mode == "--fuzz") {
+        long long inputs = 1000000, seed = 1;
+        for (; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--inputs") {
+                if (!readNumberArg(argc, argv, i, 1, inputs)) return 1;
+            } else if (arg == "--seed") {
+                if (!readNumberArg(argc, argv, i, 0, seed)) return 1;
+            } else {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return 1;
+            }
+        }
+        return runFuzz(inputs, static_cast<unsigned long long>(seed));
+    }
+    if (mode == "--shuffle-check") {
+        long long shuffles = 1000000, seed = 1, threads = 0;
+        std::string backend;
+        for (; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--shuffles") {
+                if (!readNumberArg(argc, argv, i, 1, shuffles)) return 1;
+            } else if (arg == "--seed") {
+                if (!readNumberArg(argc, argv, i, 0, seed)) return 1;
+            } else if (arg == "--threads") {
+                if (!readNumberArg(argc, argv, i, 1, threads)) return 1;
+            } else if (arg == "--backend" && i + 1 < argc) {
+                backend = argv[++i];
+            } else {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return 1;
+            }
+        }
+        return runShuffleCheck(shuffles, static_cast<unsigned long long>(seed), static_cast<int>(threads), backend);
+    }
+    if (mode == "--watch") {
+        WatchConfig watch;
+        long long value = 0;
+        for (; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--seats") {
+                if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+                watch.seats = static_cast<int>(std::min<long long>(value, TableRules::maxSeats));
+            } else if (arg == "--rounds") {
+                if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+                watch.rounds = value;
+            } else if (arg == "--delay") {
+                if (!readNumberArg(argc, argv, i, 0, value)) return 1;
+                watch.delayMs = static_cast<int>(value);
+            } else if (arg == "--decks") {
+                if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+                watch.decks = static_cast<int>(value);
+            } else if (arg == "--bet") {
+                if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+                watch.bet = value;
+            } else if (arg == "--seed") {
+                if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+                watch.seed = static_cast<unsigned>(value);
+            } else if (arg == "--observers") {
+                if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+                watch.observers = static_cast<int>(std::min<long long>(value, 4096));
+            } else if (arg == "--observe-port") {
+                if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+                if (value > 65535) {
+                    std::cerr << "--observe-port must be a TCP port." << std::endl;
+                    return 1;
+                }
+                watch.observePort = static_cast<int>(value);
+            } else {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return 1;
+            }
+        }
+        return runWatch(watch);
+    }
+    if (mode == "--side-bet-odds") {
+        long long decks = 0;
+        for (; i < argc; ++i) {
+            if (std::string(argv[i]) != "--decks") {
+                std::cerr << "Unknown option: " << argv[i] << std::endl;
+                return 1;
+            }
+            if (!readNumberArg(argc, argv, i, 1, decks)) return 1;
+        }
+        return runSideBetOdds(static_cast<int>(decks));
+    }
+    if (mode == "--bench") {
+        bool json = false;
+        double minSeconds = 0.25;
+        for (; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--json") {
+                json = true;
+            } else if (arg == "--min-time" && i + 1 < argc) {
+                minSeconds = std::atof(argv[++i]);
+            } else {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return 1;
+            }
+        }
+        return runBenchmarkSuite(json, minSeconds > 0.0 ? minSeconds : 0.25);
+    }
+    if (mode == "--compare") {
+        if (argc < 4 || !parseStrategy(argv[2], cfg.strategy) || !parseStrategy(argv[3], cfg.otherStrategy)) {
+            std::cerr << "--compare needs two strategies (basic, dealer, never-bust)." << std::endl;
+            return 1;
+        }
+        i = 4;
+    } else if (mode != "--simulate" && mode != "--bankroll") {
+        printUsage();
+        return mode == "--help" ? 0 : 1;
+    }
+
+    for (; i < argc; ++i) {
+        std::string arg = argv[i];
+        long long value = 0;
+        if (arg == "--strategy" && i + 1 < argc) {
+            if (!parseStrategy(argv[++i], cfg.strategy)) {
+                std::cerr << "Unknown strategy: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--antithetic") {
+            cfg.antithetic = true;
+        } else if (arg == "--side-bets") {
+            cfg.sideBets = true;
+        } else if (arg == "--h17") {
+            cfg.rules.hitSoft17 = true;
+        } else if (arg == "--blackjack-pays" && i + 1 < argc) {
+            int num = 0, den = 0;
+            if (std::sscanf(argv[++i], "%d:%d", &num, &den) != 2 || num < 1 || den < 1) {
+                std::cerr << "--blackjack-pays needs a payout such as 3:2 or 6:5." << std::endl;
+                return 1;
+            }
+            cfg.rules.blackjackNum = num;
+            cfg.rules.blackjackDen = den;
+        } else if (arg == "--reshuffle-at") {
+            if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+            cfg.rules.reshuffleBelow = static_cast<int>(value);
+        } else if (arg == "--records" && i + 1 < argc) {
+            cfg.recordsPath = argv[++i];
+        } else if (arg == "--records-format" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format != "csv" && format != "columnar") {
+                std::cerr << "--records-format is csv or columnar." << std::endl;
+                return 1;
+            }
+            cfg.recordsCsv = (format == "csv");
+        } else if (arg == "--hands") {
+            if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+            cfg.hands = value;
+        } else if (arg == "--decks") {
+            if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+            cfg.decks = static_cast<int>(value);
+        } else if (arg == "--rounds-per-trial") {
+            if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+            cfg.roundsPerTrial = static_cast<int>(value);
+        } else if (arg == "--seed") {
+            if (!readNumberArg(argc, argv, i, 0, value)) return 1;
+            cfg.seed = static_cast<unsigned>(value);
+        } else if (arg == "--threads") {
+            if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+            cfg.threads = static_cast<int>(value);
+        } else if (arg == "--sessions") {
+            if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+            bank.sessions = value;
+        } else if (arg == "--start") {
+            if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+            bank.bankroll = Money::dollars(value);
+        } else if (arg == "--bet") {
+            if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+            bank.bet = Money::dollars(value);
+        } else if (arg == "--bet-fraction" && i + 1 < argc) {
+            bank.betFraction = std::atof(argv[++i]);
+            if (bank.betFraction <= 0.0 || bank.betFraction > 1.0) {
+                std::cerr << "--bet-fraction must be in (0, 1]." << std::endl;
+                return 1;
+            }
+        } else if (arg == "--stop-win") {
+            if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+            bank.stopWin = Money::dollars(value);
+        } else if (arg == "--stop-loss") {
+            if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+            bank.stopLoss = Money::dollars(value);
+        } else if (arg == "--max-rounds") {
+            if (!readNumberArg(argc, argv, i, 1, value)) return 1;
+            bank.maxRounds = static_cast<int>(value);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (cfg.rules.reshuffleBelow >= cfg.decks * 52) {
+        std::cerr << "--reshuffle-at must be below the shoe size (" << cfg.decks * 52 << " cards)." << std::endl;
+        return 1;
+    }
+    if (mode == "--compare") {
+        if (cfg.roundsPerTrial == 0) cfg.roundsPerTrial = 1;
+        return runComparison(cfg);
+    }
+    if (mode == "--bankroll") {
+        return runBankroll(cfg, bank);
     }
+    if (cfg.roundsPerTrial == 0) cfg.roundsPerTrial = 100;
+    return runSimulation(cfg);
 }
 
-// Deals a single card from the deck
-Card dealCard(std::vector<Card>& deck) {
-    checkDeck(deck);
-    Card drawnCard = deck.back();
-    deck.pop_back();
-    return drawnCard;
+// --- Table Options ---
+
+struct TableOptions {
+    std::string metricsFile;
+    double metricsInterval = 5.0;
+    bool sideBets = false;
+    int maxSeats = TableRules::maxSeats;
+    int observePort = 0;
+    std::string evTable;
+};
+
+// Options that configure the interactive table rather than select a tool mode
+bool isTableOption(const std::string& arg) {
+    return arg == "--metrics-file" || arg == "--metrics-interval" || arg == "--side-bets" || arg == "--max-seats" ||
+           arg == "--observe-port" || arg == "--ev-table";
 }
 
-// Clears the input buffer to prevent skipping inputs
-void clearInputBuffer() {
-    std::cin.clear();
-    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+bool parseTableOptions(int argc, char* argv[], TableOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--metrics-file" && i + 1 < argc) {
+            options.metricsFile = argv[++i];
+        } else if (arg == "--side-bets") {
+            options.sideBets = true;
+        } else if (arg == "--max-seats" && i + 1 < argc) {
+            options.maxSeats = std::atoi(argv[++i]);
+            if (options.maxSeats < 1) {
+                std::cerr << "--max-seats must be at least 1." << std::endl;
+                return false;
+            }
+        } else if (arg == "--ev-table" && i + 1 < argc) {
+            options.evTable = argv[++i];
+        } else if (arg == "--observe-port" && i + 1 < argc) {
+            options.observePort = std::atoi(argv[++i]);
+            if (options.observePort < 1 || options.observePort > 65535) {
+                std::cerr << "--observe-port must be a TCP port." << std::endl;
+                return false;
+            }
+        } else if (arg == "--metrics-interval" && i + 1 < argc) {
+            options.metricsInterval = std::atof(argv[++i]);
+            if (options.metricsInterval <= 0.0) {
+                std::cerr << "--metrics-interval must be positive." << std::endl;
+                return false;
+            }
+        } else {
+            std::cerr << "Unknown table option: " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
 }
 
 // --- MAIN FUNCTION ---
+// A -DBJ_FUZZ build links against libFuzzer, which brings its own main
+#ifndef BJ_FUZZ
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && !isTableOption(argv[1])) {
+        return runCommandLine(argc, argv);
+    }
+
+    TableOptions options;
+    if (!parseTableOptions(argc, argv, options)) {
+        return 1;
+    }
+    MetricsExporter metricsExporter;
+    if (!options.metricsFile.empty()) {
+        metricsExporter.start(options.metricsFile, options.metricsInterval);
+    }
+    SnapshotBus observerBus;
+    ObserverServer observerServer;
+    if (options.observePort > 0) {
+        if (!observerServer.start(options.observePort, observerBus)) {
+            std::cerr << "Cannot listen on 127.0.0.1:" << options.observePort << std::endl;
+            return 1;
+        }
+        std::cout << "Observers can connect to 127.0.0.1:" << options.observePort << std::endl;
+    }
+    long long roundNumber = 0;
+
+    // Hints use the entry for the table's rules and its single-deck shoe, found once
+    EvTable evTable;
+    const EvTableEntry* evEntry = nullptr;
+    if (!options.evTable.empty()) {
+        std::string error;
+        if (!evTable.open(options.evTable, error)) {
+            std::cerr << "EV table: " << error << std::endl;
+            return 1;
+        }
+        evEntry = evTable.find(runtimeRulesOf(TableRules()), 1);
+        if (evEntry == nullptr) std::cerr << "EV table has no entry for this table's rules; no hints." << std::endl;
+    }
+    PROFILE_INSTALL();
 
-int main() {
     // This variable ensures the entire program can restart from scratch
     bool fullProgramRunning = true;
 
@@ -139,19 +5135,29 @@ int main() {
         std::cout << "        WELCOME TO BLACKJACK            " << std::endl;
         std::cout << "========================================" << std::endl;
 
+        ShoePool shoePool;
+        shoePool.start();
         std::vector<Card> deck;
-        createDeck(deck);
-        shuffleDeck(deck);
+        if (!shoePool.take(deck)) {
+            createDeck(deck);
+            shuffleDeck(deck);
+        }
 
-        std::vector<Player> players;
+        SeatTable table;
         int numPlayers = 0;
+        Hand dealerHand;
+        // Publishes the table as it stands; a no-op with no observers attached
+        auto publishSnapshot = [&](SnapshotPhase phase, bool holeHidden) {
+            if (options.observePort == 0) return;
+            observerBus.publish(std::make_shared<TableSnapshot>(roundNumber, phase, table, dealerHand, holeHidden));
+        };
         
         // Get number of players
-        while (numPlayers < 1 || numPlayers > 4) {
-            std::cout << "How many players will play? (1-4): ";
+        while (numPlayers < 1 || numPlayers > options.maxSeats) {
+            std::cout << "How many players will play? (1-" << options.maxSeats << "): ";
             std::cin >> numPlayers;
-            if (std::cin.fail() || numPlayers < 1 || numPlayers > 4) {
-                std::cout << "Please enter a number between 1 and 4." << std::endl;
+            if (std::cin.fail() || numPlayers < 1 || numPlayers > options.maxSeats) {
+                std::cout << "Please enter a number between 1 and " << options.maxSeats << "." << std::endl;
                 clearInputBuffer();
                 numPlayers = 0;
             }
@@ -162,48 +5168,60 @@ int main() {
             std::string name;
             std::cout << (i + 1) << ". Player's name: ";
             std::cin >> name;
-            players.push_back({name, {}, 100, 0, PLAYING}); 
+            table.addSeat(name, Money::dollars(100));
         }
 
         // --- INNER LOOP (ROUND LOOP) ---
         bool gameIsRunning = true;
         while (gameIsRunning) {
             
+            PROFILE_POLL();
             std::cout << "\n--- NEW ROUND ---" << std::endl;
-            std::vector<Card> dealerHand;
+            dealerHand.clear();
             int activePlayersThisRound = 0;
 
             // 1. Betting Phase
-            for (auto& player : players) {
-                if (player.status == QUIT) continue; 
-
-                if (player.money <= 0) {
-                    std::cout << player.name << " ran out of money and left the game." << std::endl;
-                    player.status = QUIT;
+            for (int seat : table.seats(ACTIVE_SEATS)) {
+                PROFILE_PHASE(PHASE_BET_INPUT);
+                if (table.money[seat] < TABLE_MIN_BET) {
+                    std::cout << table.names[seat] << " ran out of money and left the game." << std::endl;
+                    table.setStatus(seat, QUIT);
                     continue;
                 }
 
-                player.hand.clear();
-                player.status = PLAYING;
-                player.currentBet = 0;
+                table.hands[seat].clear();
+                table.setStatus(seat, PLAYING);
+                table.bets[seat] = Money();
+                table.pairBets[seat] = Money();
+                table.threeCardBets[seat] = Money();
 
                 std::cout << "--------------------" << std::endl;
-                std::cout << player.name << " (Balance: $" << player.money << ")" << std::endl;
+                std::cout << table.names[seat] << " (Balance: $" << table.money[seat] << ")" << std::endl;
                 
+                // Bets are whole dollars; a balance can still hold cents after a 3:2 payout
+                long long maxBet = table.money[seat].wholeDollars();
                 while (true) {
-                    std::cout << "Enter bet (Min 1, Max " << player.money << "): ";
-                    std::cin >> player.currentBet;
+                    long long amount = 0;
+                    std::cout << "Enter bet (Min 1, Max " << maxBet << "): ";
+                    std::cin >> amount;
                     if (std::cin.fail()) {
                         std::cout << "Please enter a valid number." << std::endl;
                         clearInputBuffer();
-                    } else if (player.currentBet > player.money) {
+                    } else if (amount > maxBet) {
                         std::cout << "Insufficient funds." << std::endl;
-                    } else if (player.currentBet <= 0) {
+                    } else if (amount <= 0) {
                         std::cout << "Invalid bet. (Min 1)" << std::endl;
                     } else {
+                        table.bets[seat] = Money::dollars(amount);
                         break; 
                     }
                 }
+                // Side bets come out of what the main bet leaves
+                if (options.sideBets && maxBet > table.bets[seat].wholeDollars()) {
+                    table.pairBets[seat] = promptSideBet("Perfect Pairs", maxBet - table.bets[seat].wholeDollars());
+                    long long left = maxBet - table.bets[seat].wholeDollars() - table.pairBets[seat].wholeDollars();
+                    if (left > 0) table.threeCardBets[seat] = promptSideBet("21+3", left);
+                }
                 activePlayersThisRound++;
             }
 
@@ -213,88 +5231,112 @@ int main() {
                 gameIsRunning = false;
                 continue; 
             }
+            addMetric(METRIC_ROUNDS);
+            addMetric(METRIC_HANDS_DEALT, activePlayersThisRound);
+            roundNumber++;
+            publishSnapshot(SNAP_BETTING, true);
 
             // 2. Dealing Initial Cards
-            for (auto& player : players) {
-                if (player.status != QUIT) player.hand.push_back(dealCard(deck));
-            }
-            dealerHand.push_back(dealCard(deck));
-            
-            for (auto& player : players) {
-                if (player.status != QUIT) player.hand.push_back(dealCard(deck));
+            {
+                PROFILE_PHASE(PHASE_DEALING);
+                checkDeck(deck, true, &shoePool); // The round's one cut-card check
+                dealInitialCards(deck, table, ACTIVE_SEATS, activePlayersThisRound, dealerHand, &shoePool);
             }
-            dealerHand.push_back(dealCard(deck));
 
             bool dealerHasBJ = (calculateHandTotal(dealerHand) == 21);
             printHand("Dealer", dealerHand, true);
 
+            // Side bets settle on the initial deal, before anyone acts
+            for (int seat : table.seats(statusBit(PLAYING))) {
+                const Hand& hand = table.hands[seat];
+                if (table.pairBets[seat] > Money()) {
+                    PairResult result = pairResult(hand[0], hand[1]);
+                    Money delta = table.pairBets[seat] * PAIR_PAYS[result];
+                    table.money[seat] += delta;
+                    addMetric(METRIC_HOUSE_NET, -delta.inCents());
+                    std::cout << table.names[seat] << ": Perfect Pairs - " << PAIR_NAMES[result]
+                              << (delta > Money() ? " wins $" : " loses $") << delta.absolute() << std::endl;
+                }
+                if (table.threeCardBets[seat] > Money()) {
+                    ThreeCardResult result = threeCardResult(hand[0], hand[1], dealerHand[1]);
+                    Money delta = table.threeCardBets[seat] * THREE_CARD_PAYS[result];
+                    table.money[seat] += delta;
+                    addMetric(METRIC_HOUSE_NET, -delta.inCents());
+                    std::cout << table.names[seat] << ": 21+3 - " << THREE_CARD_NAMES[result]
+                              << (delta > Money() ? " wins $" : " loses $") << delta.absolute() << std::endl;
+                }
+            }
+
             // 3. Check for Initial Blackjack
-            for (auto& player : players) {
-                if (player.status == PLAYING) {
-                    printHand(player.name, player.hand);
-                    if (calculateHandTotal(player.hand) == 21) {
-                        if (dealerHasBJ) {
-                            std::cout << player.name << ": Push (Tie). Both have Blackjack." << std::endl;
-                            player.status = STANDING; 
-                        } else {
-                            std::cout << player.name << ": BLACKJACK! Pays 3:2." << std::endl;
-                            player.status = BLACKJACK; 
-                        }
-                    } else if (dealerHasBJ) {
-                        std::cout << player.name << ": Lost. Dealer has Blackjack." << std::endl;
-                        player.status = BUSTED; 
-                    }
+            for (int seat : table.seats(statusBit(PLAYING))) {
+                printHand(table.names[seat], table.hands[seat]);
+                PlayerStatus status = initialStatus(calculateHandTotal(table.hands[seat]), dealerHasBJ);
+                table.setStatus(seat, status);
+                if (status == STANDING) {
+                    std::cout << table.names[seat] << ": Push (Tie). Both have Blackjack." << std::endl;
+                } else if (status == BLACKJACK) {
+                    std::cout << table.names[seat] << ": BLACKJACK! Pays 3:2." << std::endl;
+                } else if (status == BUSTED) {
+                    std::cout << table.names[seat] << ": Lost. Dealer has Blackjack." << std::endl;
                 }
             }
+            publishSnapshot(SNAP_DEALT, true);
             
             // 4. Players' Turns
             if (!dealerHasBJ) { 
-                for (auto& player : players) {
-                    if (player.status != PLAYING) continue; 
-
-                    std::cout << "\n--- " << player.name << "'s turn ---" << std::endl;
+                for (int seat : table.seats(statusBit(PLAYING))) {
+                    std::cout << "\n--- " << table.names[seat] << "'s turn ---" << std::endl;
                     
-                    while (player.status == PLAYING) {
+                    while (table.statusOf(seat) == PLAYING) {
                         char choice = ' ';
-                        while (choice != '1' && choice != '0') {
-                            std::cout << player.name << ", Hit (1) or Stand (0)? ";
-                            std::cin >> choice;
+                        {
+                            PROFILE_PHASE(PHASE_DECISION);
+                            auto promptedAt = std::chrono::steady_clock::now();
+                            if (evEntry != nullptr) {
+                                std::cout << "Suggest: " << evHint(*evEntry, table.hands[seat], dealerHand[1].value)
+                                          << std::endl;
+                            }
+                            while (choice != '1' && choice != '0') {
+                                std::cout << table.names[seat] << ", Hit (1) or Stand (0)? ";
+                                std::cin >> choice;
+                            }
+                            recordDecisionLatency(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::steady_clock::now() - promptedAt).count());
                         }
 
                         if (choice == '1') {
-                            player.hand.push_back(dealCard(deck));
-                            printHand(player.name, player.hand);
-                            if (calculateHandTotal(player.hand) > 21) {
-                                std::cout << player.name << " Busted!" << std::endl;
-                                player.status = BUSTED;
+                            PROFILE_PHASE(PHASE_DEALING);
+                            table.hands[seat].push_back(dealCard(deck, &shoePool));
+                            printHand(table.names[seat], table.hands[seat]);
+                            if (calculateHandTotal(table.hands[seat]) > 21) {
+                                std::cout << table.names[seat] << " Busted!" << std::endl;
+                                table.setStatus(seat, BUSTED);
                             }
                         } else if (choice == '0') {
-                            player.status = STANDING;
+                            table.setStatus(seat, STANDING);
                         }
+                        publishSnapshot(SNAP_DECISION, true);
                     }
                 }
             }
 
             // 5. Dealer's Turn
-            bool dealerMustPlay = false;
-            for (const auto& player : players) {
-                if (player.status == STANDING) { 
-                    dealerMustPlay = true;
-                    break;
-                }
-            }
+            bool dealerMustPlay = table.any(STANDING);
 
             bool dealerBusted = false;
             if (dealerMustPlay) {
+                PROFILE_PHASE(PHASE_DEALER_PLAY);
                 std::cout << "\n--- Dealer's Turn ---" << std::endl;
                 std::this_thread::sleep_for(std::chrono::milliseconds(1000));
                 printHand("Dealer", dealerHand, false); 
+                publishSnapshot(SNAP_DEALER, false); // The hole card is revealed even if the dealer stands
 
-                while (calculateHandTotal(dealerHand) < 17) {
+                while (dealerShouldHit(dealerHand)) {
                     std::cout << "Dealer draws a card..." << std::endl;
                     std::this_thread::sleep_for(std::chrono::milliseconds(1500));
-                    dealerHand.push_back(dealCard(deck));
+                    dealerHand.push_back(dealCard(deck, &shoePool));
                     printHand("Dealer", dealerHand, false);
+                    publishSnapshot(SNAP_DEALER, false);
                 }
                 
                 if (calculateHandTotal(dealerHand) > 21) {
@@ -303,6 +5345,7 @@ int main() {
                 }
             } else {
                  printHand("Dealer", dealerHand, false); 
+                 publishSnapshot(SNAP_DEALER, false);
             }
 
             // 6. Calculate Results
@@ -310,30 +5353,34 @@ int main() {
             int dealerTotal = calculateHandTotal(dealerHand);
             std::cout << "Dealer Total: " << dealerTotal << std::endl;
 
-            for (auto& player : players) {
-                if (player.status == QUIT) continue;
+            for (int seat : table.seats(ACTIVE_SEATS)) {
+                PROFILE_PHASE(PHASE_SETTLEMENT);
+                int playerTotal = calculateHandTotal(table.hands[seat]);
+                std::cout << table.names[seat] << "'s Total: " << playerTotal;
 
-                int playerTotal = calculateHandTotal(player.hand);
-                std::cout << player.name << "'s Total: " << playerTotal;
+                Money delta = settleBet(table.statusOf(seat), table.bets[seat], playerTotal, dealerTotal, dealerBusted);
+                table.money[seat] += delta;
+                addMetric(METRIC_HOUSE_NET, -delta.inCents());
 
-                switch (player.status) {
+                switch (table.statusOf(seat)) {
                     case BLACKJACK:
-                        player.money += (player.currentBet * 3) / 2;
-                        std::cout << " (Blackjack - Balance: $" << player.money << ")" << std::endl;
+                        addMetric(METRIC_BLACKJACK_WIN);
+                        std::cout << " (Blackjack - Balance: $" << table.money[seat] << ")" << std::endl;
                         break;
                     case BUSTED:
-                        player.money -= player.currentBet;
-                        std::cout << " (Busted - Balance: $" << player.money << ")" << std::endl;
+                        addMetric(METRIC_BUSTED_LOSS);
+                        std::cout << " (Busted - Balance: $" << table.money[seat] << ")" << std::endl;
                         break;
                     case STANDING:
-                        if (dealerBusted || playerTotal > dealerTotal) {
-                            player.money += player.currentBet;
-                            std::cout << " (Won - Balance: $" << player.money << ")" << std::endl;
-                        } else if (playerTotal < dealerTotal) {
-                            player.money -= player.currentBet;
-                            std::cout << " (Lost - Balance: $" << player.money << ")" << std::endl;
+                        if (delta > Money()) {
+                            addMetric(METRIC_STANDING_WIN);
+                            std::cout << " (Won - Balance: $" << table.money[seat] << ")" << std::endl;
+                        } else if (delta < Money()) {
+                            addMetric(METRIC_STANDING_LOSS);
+                            std::cout << " (Lost - Balance: $" << table.money[seat] << ")" << std::endl;
                         } else {
-                            std::cout << " (Push/Tie - Balance: $" << player.money << ")" << std::endl;
+                            addMetric(METRIC_STANDING_PUSH);
+                            std::cout << " (Push/Tie - Balance: $" << table.money[seat] << ")" << std::endl;
                         }
                         break;
                     default:
@@ -341,13 +5388,15 @@ int main() {
                 }
             }
             
+            publishSnapshot(SNAP_SETTLED, false);
+
             // 7. Check Continuation
             bool anyoneLeft = false;
-            for (auto& player : players) {
-                if (player.status == QUIT) continue;
-                if (player.money <= 0) {
-                     std::cout << player.name << " ran out of money and was removed from the game." << std::endl;
-                     player.status = QUIT;
+            for (int seat : table.seats(ACTIVE_SEATS)) {
+                PROFILE_PHASE(PHASE_CONTINUE_INPUT);
+                if (table.money[seat] < TABLE_MIN_BET) {
+                     std::cout << table.names[seat] << " ran out of money and was removed from the game." << std::endl;
+                     table.setStatus(seat, QUIT);
                      continue;
                 }
                 
@@ -355,12 +5404,12 @@ int main() {
                 anyoneLeft = true;
                 char choice = ' ';
                 while (choice != 'y' && choice != 'n') {
-                     std::cout << player.name << ", do you want to continue? (y/n): ";
+                     std::cout << table.names[seat] << ", do you want to continue? (y/n): ";
                      std::cin >> choice;
                 }
                 if (choice == 'n') {
-                    player.status = QUIT;
-                    std::cout << player.name << " left the game." << std::endl;
+                    table.setStatus(seat, QUIT);
+                    std::cout << table.names[seat] << " left the game." << std::endl;
                 }
             }
 
@@ -371,13 +5420,16 @@ int main() {
 
         } // --- INNER LOOP END (gameIsRunning) ---
 
+        publishSnapshot(SNAP_CLOSED, false);
+
         // --- GAME OVER REPORT ---
         std::cout << "\n----------------------------------------" << std::endl;
         std::cout << "Game Over." << std::endl;
         std::cout << "--- FINAL BALANCES ---" << std::endl;
-        for (const auto& player : players) {
-             std::cout << player.name << ": $" << player.money << std::endl;
+        for (int seat = 0; seat < table.size(); ++seat) {
+             std::cout << table.names[seat] << ": $" << table.money[seat] << std::endl;
         }
+        PROFILE_DUMP();
         std::cout << "----------------------------------------" << std::endl;
 
         // --- RESTART QUESTION ---
@@ -396,6 +5448,10 @@ int main() {
 
     } // --- OUTER LOOP END (fullProgramRunning) ---
 
+    observerBus.close();
+    observerServer.stop();
+    metricsExporter.stop();
     std::cout << "See you next time!" << std::endl;
     return 0;
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file